@@ -2,13 +2,14 @@
 #include "utils.h"
 #include "args.h"
 #include "version.h"
+#include "cfsBasicComponents.h"
 
 using namespace cfs;
 utils::PreDefinedArgumentType::PreDefinedArgument fsckMainArgument = {
     { .short_name = 'h',    .long_name = "help",        .argument_required = false,     .description = "Show help" },
     { .short_name = 'v',    .long_name = "version",     .argument_required = false,     .description = "Show version" },
     { .short_name = 'p',    .long_name = "path",        .argument_required = true,      .description = "Path to CFS archive file" },
-    { .short_name = -1,     .long_name = "modify",      .argument_required = true,      .description = "Apply changes to the file system" },
+    { .short_name = -1,     .long_name = "modify",      .argument_required = false,     .description = "Apply changes to the file system" },
 };
 
 int fsck_main(int argc, char** argv)
@@ -31,14 +32,36 @@ int fsck_main(int argc, char** argv)
             return EXIT_SUCCESS;
         }
 
-        if (parsed.contains("path")) {
-            const auto & path = parsed["path"];
-            ilog("CFS target is ", path, "\n");
-        } else {
+        if (!parsed.contains("path")) {
             throw std::invalid_argument("Missing CFS file path");
         }
 
-        return EXIT_SUCCESS;
+        const auto & path = parsed["path"];
+        const bool modify = parsed.contains("modify");
+        ilog("CFS target is ", path, "\n");
+
+        // replay the journal tail, the same mount does, but only change anything when asked to.
+        // otherwise the image is mapped read only, opening it would clear its clean flag and more
+        filesystem fs(path, !modify);
+        cfs_journaling_t journal(&fs);
+        cfs_bitmap_block_mirroring_t bitmap(&fs, &journal);
+        cfs_block_attribute_access_t block_attribute(&fs, &journal);
+        const auto report = cfs_journal_replay_t(&fs, &journal, &bitmap, &block_attribute).replay(modify);
+
+        ilog("Journal records since last replay: ", report.scanned, "\n");
+        ilog("Interrupted transactions: ", report.interrupted, "\n");
+        ilog(modify ? "Rolled back: " : "Can be rolled back: ", report.rolled_back, "\n");
+        ilog(modify ? "Rolled forward: " : "Can be rolled forward: ", report.rolled_forward, "\n");
+        std::ranges::for_each(report.unresolved, [](const cfs_action_t & action)
+        {
+            const auto & plain = action.action_data.action_plain;
+            std::stringstream type;
+            type << std::hex << plain.action_param0;
+            wlog("Unresolved: #", action.sequence, " type=0x", type.str(),
+                " [", plain.action_param1, ", ", plain.action_param2, ", ", plain.action_param3, "]\n");
+        });
+
+        return report.unresolved.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
     }
     catch (std::exception & e) {
         elog(e.what(), "\n");
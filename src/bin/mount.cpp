@@ -9,6 +9,7 @@
 # include <fuse.h>
 # include <cstdlib>
 # include <sys/ioctl.h>
+# include <linux/fs.h>
 # include <pthread.h>
 namespace utils = cfs::utils;
 
@@ -19,6 +20,9 @@ utils::PreDefinedArgumentType::PreDefinedArgument mountMainArgument = {
     { .short_name = 'f', .long_name = "fuse",       .argument_required = true,  .description = "Fuse arguments" },
     { .short_name = 'e', .long_name = "endpoint",   .argument_required = true,  .description = "Mount endpoint" },
     { .short_name = -1,  .long_name = "nocow",      .argument_required = false, .description = "Disable Copy-On-Write" },
+    { .short_name = -1,  .long_name = "overwrite-exclusive", .argument_required = false, .description = "Modify blocks no snapshot can see in place, only CoW frozen blocks" },
+    { .short_name = -1,  .long_name = "txg-timeout",.argument_required = true,  .description = "Enable transaction groups, committed after this many seconds. Off by default" },
+    { .short_name = -1,  .long_name = "reclaim-watermark",.argument_required = true,  .description = "Reclaim CoW redundancies in background when free space drops below this percentage" },
 };
 
 extern "C" struct snapshot_ioctl_msg {
@@ -165,10 +169,35 @@ static int fuse_do_symlink(const char *path, const char *target) {
     return cfs_entity_ptr->do_symlink(path, target);
 }
 
-static int fuse_do_ioctl(const char *, const unsigned int cmd, void *,
+static int fuse_do_ioctl(const char * path, const unsigned int cmd, void *,
                          fuse_file_info *, const unsigned int flags, void *data)
 {
     set_thread_name("fuse_do_ioctl");
+
+    // chattr/lsattr, only NOCOW (chattr +C) is supported
+    if (cmd == FS_IOC_GETFLAGS || cmd == FS_IOC_SETFLAGS)
+    {
+        auto * fs_flags = static_cast<unsigned int *>(data);
+        cfs::stat cfs_stbuf{};
+        if (const int result = cfs_entity_ptr->do_getattr(path, &cfs_stbuf); result != 0) {
+            return result;
+        }
+
+        if (cmd == FS_IOC_GETFLAGS) {
+            *fs_flags = (cfs_stbuf.st_flags & cfs::inode_flag_nocow) ? FS_NOCOW_FL : 0;
+            return 0;
+        }
+
+        if (*fs_flags & ~FS_NOCOW_FL) {
+            return -EOPNOTSUPP;
+        }
+
+        const uint32_t new_flags = (*fs_flags & FS_NOCOW_FL)
+            ? (cfs_stbuf.st_flags | cfs::inode_flag_nocow)
+            : (cfs_stbuf.st_flags & ~cfs::inode_flag_nocow);
+        return cfs_entity_ptr->do_chflags(path, new_flags);
+    }
+
     if (!(flags & FUSE_IOCTL_DIR)) {
         return -ENOTTY;
     }
@@ -215,6 +244,8 @@ static int fuse_do_readlink(const char *path, char *buffer, const size_t size)
 
 void fuse_do_destroy(void *) {
     set_thread_name("fuse_do_destroy");
+    cfs_entity_ptr->stop_background_reclaim();
+    cfs_entity_ptr->set_transaction_group_timeout(0); // commit the open group and stop its timer
 }
 
 void *fuse_do_init(fuse_conn_info *conn, fuse_config *)
@@ -227,6 +258,7 @@ void *fuse_do_init(fuse_conn_info *conn, fuse_config *)
     // fuse_set_feature_flag(conn, FUSE_CAP_SPLICE_WRITE);
     // fuse_set_feature_flag(conn, FUSE_CAP_SPLICE_MOVE);
     conn->max_write = 256 * 1024 * 1024;
+    cfs_entity_ptr->start_background_reclaim();
     return nullptr;
 }
 
@@ -364,6 +396,9 @@ int mount_main(int argc, char **argv)
 
         cfs_entity_ptr = std::make_unique<cfs::CowFileSystem>(parsed.at("path"));
         if (parsed.contains("nocow")) cfs_entity_ptr->set_nocow();
+        if (parsed.contains("overwrite-exclusive")) cfs_entity_ptr->set_overwrite_exclusive();
+        if (parsed.contains("txg-timeout")) cfs_entity_ptr->set_transaction_group_timeout(std::stoull(parsed.at("txg-timeout")));
+        if (parsed.contains("reclaim-watermark")) cfs_entity_ptr->set_reclaim_watermark(std::stoull(parsed.at("reclaim-watermark")));
         return fuse_redirect(d_fuse_argc, d_fuse_argv);
     }
     catch (const std::exception & e)
@@ -116,26 +116,63 @@ static std::string translate_action_into_literal(const cfs::cfs_action_t & actio
             }
         break;
 
+        case cfs::JournalReplayed:
+            ss << highlight(cfs::JournalReplayed_c_str)
+               << " Interrupted=" << highlight_val(action.action_data.action_plain.action_param0)
+               << ", RolledBack=" << highlight_val(action.action_data.action_plain.action_param1)
+               << ", RolledForward=" << highlight_val(action.action_data.action_plain.action_param2);
+        break;
+
+        case cfs::TransactionGroupCommit:
+            ss << highlight(cfs::TransactionGroupCommit_c_str)
+               << " ID=" << highlight_val(action.action_data.action_plain.action_param0)
+               << ", Blocks=" << highlight_val(action.action_data.action_plain.action_param1);
+        break;
+
         case cfs::GlobalTransaction:
-            ss << cfs::GlobalTransaction_c_str << " ";
+        case cfs::NestedTransaction:
+            ss << (action.action_data.action_plain.action == cfs::NestedTransaction
+                ? cfs::NestedTransaction_c_str : cfs::GlobalTransaction_c_str) << " ";
             switch (action.action_data.action_plain.action_param0) {
                 replicate(GlobalTransaction_AllocateBlock, "");
                 replicate(GlobalTransaction_DeallocateBlock, " At " << highlight_pos(action.action_data.action_plain.action_param1));
                 replicate(GlobalTransaction_CreateRedundancy,
                         " For " << std::dec << highlight_pos(action.action_data.action_plain.action_param1)
                         << " At " << highlight_pos(action.action_data.action_plain.action_param2));
+                replicate(GlobalTransaction_OverwriteInPlace, " At " << highlight_pos(action.action_data.action_plain.action_param1)
+                        << ", Before-image=" << highlight_pos(action.action_data.action_plain.action_param2));
+                replicate(GlobalTransaction_AllocateRange,
+                        " Blocks=" << std::dec << highlight_val(action.action_data.action_plain.action_param1)
+                        << ", Goal=" << highlight_val(action.action_data.action_plain.action_param2));
+                replicate(GlobalTransaction_ReclaimRedundancy,
+                        " Blocks=" << std::dec << highlight_val(action.action_data.action_plain.action_param1));
                 replicate(FilesystemBitmapModification,
                         " From " << std::dec << action.action_data.action_plain.action_param1
                         << " To " << action.action_data.action_plain.action_param2
                         << " At " << action.action_data.action_plain.action_param3)
+                replicate(FilesystemBitmapRangeModification,
+                        " To " << std::dec << action.action_data.action_plain.action_param1
+                        << " At " << highlight_pos(action.action_data.action_plain.action_param2)
+                        << ", Count=" << highlight_val(action.action_data.action_plain.action_param3))
 
                 // Majors
                 replicate(GlobalTransaction_Major_WriteInode,
                     " Inode=" << highlight_val(action.action_data.action_plain.action_param1)
                     << ", Offset=" << highlight_val(action.action_data.action_plain.action_param2)
                     << ", Size=" << highlight_val(action.action_data.action_plain.action_param3)) // [Which inode] [Offset] [Size]
+                replicate(GlobalTransaction_Major_ResizeInode,
+                    " Inode=" << highlight_val(action.action_data.action_plain.action_param1)
+                    << ", Size=" << highlight_val(action.action_data.action_plain.action_param2)) // [Which inode] [Size]
                 print_default(action.action_data.action_plain.action_param0);
             }
+
+            // closing records carry the number of transactions nested inside,
+            // nested records the sequence of the outermost transaction's start record
+            if (action.action_data.action_plain.action == cfs::NestedTransaction) {
+                ss << ", In=#" << std::dec << action.action_data.action_plain.action_param4;
+            } else if (action.action_data.action_plain.action_param4 != 0) {
+                ss << ", Sub=" << highlight_val(action.action_data.action_plain.action_param4);
+            }
         break;
         print_default(action.action_data.action_plain.action);
     }
@@ -235,11 +272,25 @@ namespace cfs
         }
     }
 
+    void CowFileSystem::report_replay()
+    {
+        if (replay_report_.interrupted == 0) {
+            return;
+        }
+
+        wlog("Last session ended uncleanly, ", replay_report_.interrupted, " interrupted transaction(s) in ",
+            replay_report_.scanned, " journal record(s), ", replay_report_.rolled_back, " rolled back, ",
+            replay_report_.rolled_forward, " rolled forward\n");
+        std::ranges::for_each(replay_report_.unresolved, [](const cfs_action_t & action) {
+            wlog("Left as it is: #", action.sequence, " ", translate_action_into_literal(action), "\n");
+        });
+    }
+
     void CowFileSystem::debug_cat_journal()
     {
         const auto journal = this->journaling_.dump_actions();
         std::ranges::for_each(journal, [](const cfs_action_t & action) {
-            std::cout << translate_action_into_literal(action) << std::endl;
+            std::cout << "#" << action.sequence << " " << translate_action_into_literal(action) << std::endl;
         });
     }
 
@@ -533,6 +584,40 @@ namespace cfs
         }
     }
 
+    void CowFileSystem::nocow(const std::vector<std::string> &vec)
+    {
+        if (vec.size() != 2 && vec.size() != 3) {
+            elog("nocow [CFS Path] [on|off]\n");
+            return;
+        }
+
+        const auto path = auto_path(vec[1]);
+        struct stat status {};
+        if (const int result = do_getattr(path, &status); result != 0) {
+            elog("getattr: ", strerror(-result), "\n");
+            return;
+        }
+
+        if (vec.size() == 2) {
+            std::cout << ((status.st_flags & inode_flag_nocow) ? "on" : "off") << std::endl;
+            return;
+        }
+
+        uint32_t flags = status.st_flags;
+        if (vec[2] == "on") {
+            flags |= inode_flag_nocow;
+        } else if (vec[2] == "off") {
+            flags &= ~inode_flag_nocow;
+        } else {
+            elog("nocow [CFS Path] [on|off]\n");
+            return;
+        }
+
+        if (const int result = do_chflags(path, flags); result != 0) {
+            elog("nocow: ", strerror(-result), "\n");
+        }
+    }
+
     void CowFileSystem::free()
     {
         const auto statvfs = do_fstat();
@@ -890,6 +975,24 @@ namespace cfs
         GENERAL_CATCH()
     }
 
+    int CowFileSystem::do_chflags(const std::string &path, const uint32_t flags) noexcept
+    {
+        GENERAL_TRY() {
+            const auto vpath = path_to_vector(path);
+            const auto [child, parent]
+                = deference_inode_from_path(vpath);
+
+            if (check_entry(parent, child)) { // not normal block
+                return -EROFS; // Read-only filesystem (POSIX.1-2001).
+            }
+
+            child->chflags(flags);
+            child->set_ctime(utils::get_timespec());
+            return 0;
+        }
+        GENERAL_CATCH()
+    }
+
     int CowFileSystem::do_create(const std::string &path, const mode_t mode) noexcept
     {
         GENERAL_TRY() {
@@ -935,6 +1038,18 @@ namespace cfs
     int CowFileSystem::do_flush() noexcept
     {
         GENERAL_TRY() {
+            block_manager_.commit_bitmap();
+            cfs_basic_filesystem_.sync();
+            return 0;
+        }
+        GENERAL_CATCH()
+    }
+
+    int CowFileSystem::do_fsync(const std::string &, int) noexcept
+    {
+        GENERAL_TRY() {
+            block_manager_.transaction_group().commit();
+            block_manager_.commit_bitmap();
             cfs_basic_filesystem_.sync();
             return 0;
         }
@@ -1408,13 +1523,14 @@ namespace cfs
 
     struct statvfs CowFileSystem::do_fstat() noexcept
     {
-        const auto used = cfs_basic_filesystem_.cfs_header_block.get_info<allocated_non_cow_blocks>();
+        // exact count from the bitmap free space summary, CoW redundancies count as used until reclaimed
+        const auto free_blocks = block_manager_.free_blocks();
         struct statvfs status{};
         status.f_bsize = cfs_basic_filesystem_.static_info_.block_size;
         status.f_frsize = cfs_basic_filesystem_.static_info_.block_size;
         status.f_blocks = cfs_basic_filesystem_.static_info_.data_table_end - cfs_basic_filesystem_.static_info_.data_table_start;
-        status.f_bfree = status.f_blocks - used;
-        status.f_bavail = status.f_blocks - used;
+        status.f_bfree = free_blocks;
+        status.f_bavail = free_blocks;
         status.f_files = 0;
         status.f_ffree = 0;
         status.f_favail = 0;
@@ -1422,7 +1538,7 @@ namespace cfs
         status.f_flag = 0;
         status.f_namemax = 255;
         status.f_type = 0x65735546; // FUSE
-        dlog("Used blocks=", used, ", all blocks=", status.f_blocks, "\n");
+        dlog("Used blocks=", status.f_blocks - free_blocks, ", all blocks=", status.f_blocks, "\n");
         return status;
     }
 
@@ -1492,11 +1608,15 @@ namespace cfs
             move(vec);
         }
         else if (vec.front() =="sync") {
+            block_manager_.commit_bitmap();
             cfs_basic_filesystem_.sync();
         }
         else if (vec.front() =="cat") {
             cat(vec);
         }
+        else if (vec.front() =="nocow") {
+            nocow(vec);
+        }
         else if (vec.front() =="snapshot") {
             if (vec.size() == 2) {
                 if (const int result = do_snapshot(vec[1]); result != 0) {
@@ -1,75 +1,146 @@
 #include "cfsBasicComponents.h"
 
-void cfs::cfs_journaling_t::putc(const char c)
+void cfs::cfs_journaling_t::write(const void * data, uint64_t length)
 {
-    journal_body_[journal_header_->head] = c;
-    journal_header_->head = (journal_header_->head + 1) % capacity_;
-    if (journal_header_->size < capacity_) {
-        ++journal_header_->size;
+    auto * source = static_cast<const char *>(data);
+    if (length > capacity_)
+    {
+        // only the last capacity_ bytes survive anyway
+        source += length - capacity_;
+        length = capacity_;
+    }
+
+    const uint64_t head = journal_header_->head;
+    const uint64_t before_wrap = std::min(length, capacity_ - head);
+    std::memcpy(journal_body_ + head, source, before_wrap);
+    std::memcpy(journal_body_, source + before_wrap, length - before_wrap);
+
+    journal_header_->head = (head + length) % capacity_;
+    if (const uint64_t size = journal_header_->size + length; size > capacity_) {
+        // buffer full - discard the oldest data
+        journal_header_->tail = (journal_header_->tail + size - capacity_) % capacity_;
+        journal_header_->size = capacity_;
     } else {
-        // buffer full - discard the oldest element
-        journal_header_->tail = (journal_header_->tail + 1) % capacity_;
+        journal_header_->size = size;
+    }
+}
+
+bool cfs::cfs_journaling_t::valid(const cfs_action_t & action)
+{
+    return action.cfs_magic == cfs_journal_record_magic
+        && action.version == cfs_journal_record_version
+        && action.length == sizeof(cfs_action_t)
+        && action.sequence != 0
+        && action.record_crc32 == CRC32::C::calc(reinterpret_cast<const uint8_t *>(&action.sequence),
+            sizeof(cfs_action_t) - offsetof(cfs_action_t, sequence));
+}
+
+uint64_t cfs::cfs_journaling_t::sequence_at(const uint64_t slot) const
+{
+    const auto * action = record_at(slot);
+    return valid(*action) ? action->sequence : 0;
+}
+
+uint64_t cfs::cfs_journaling_t::valid_slot_from(uint64_t slot, const uint64_t end) const
+{
+    while (slot < end && sequence_at(slot) == 0) {
+        slot++;
     }
+
+    return slot;
 }
 
-std::vector<uint8_t> cfs::cfs_journaling_t::dump() const
+std::pair<uint64_t, uint64_t> cfs::cfs_journaling_t::newest_slot() const
 {
-    std::vector<uint8_t> out;
-    out.reserve(journal_header_->size);
-    for (size_t i = 0; i < journal_header_->size; ++i) {
-        const size_t index = (journal_header_->tail + i) % capacity_;
-        out.push_back(journal_body_[index]);
+    const uint64_t slots = capacity_ / sizeof(cfs_action_t);
+    const uint64_t lowest = valid_slot_from(0, slots);
+    if (lowest == slots) {
+        return { 0, 0 };
+    }
+
+    // the ring is written front to back, so sequences climb from slot 0 up to the newest record
+    // and then either drop to older records that are not yet overwritten, or to empty slots.
+    // a slot without a valid record has no sequence to compare, the nearest valid record after it stands in for it
+    const uint64_t first = sequence_at(lowest);
+    uint64_t begin = lowest, end = slots;
+    while (end - begin > 1)
+    {
+        const uint64_t middle = begin + (end - begin) / 2;
+        if (const uint64_t probe = valid_slot_from(middle, end); probe != end && sequence_at(probe) >= first) {
+            begin = probe;
+        } else {
+            end = middle; // nothing valid up to end, or an older record
+        }
     }
-    return out;
+
+    return { begin, sequence_at(begin) };
+}
+
+uint64_t cfs::cfs_journaling_t::newest_sequence()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    return newest_slot().second;
 }
 
 cfs::cfs_journaling_t::cfs_journaling_t(cfs::filesystem *parent_fs_governor):
     parent_fs_governor_(parent_fs_governor),
     journal_start_(parent_fs_governor->static_info_.journal_start),
     journal_end_(parent_fs_governor->static_info_.journal_end),
-    block_size_(parent_fs_governor->static_info_.block_size)
+    block_size_(parent_fs_governor->static_info_.block_size),
+    journal_lock_(parent_fs_governor->lock_continuous(journal_start_, journal_end_ - journal_start_))
 {
-    for (auto i = parent_fs_governor->static_info_.journal_start; i < parent_fs_governor->static_info_.journal_end; i++) {
-        parent_fs_governor->bitlocker_.lock(i);
-    }
-
-    journal_raw_buffer_ = parent_fs_governor->file_.data() + journal_start_ * block_size_;
+    journal_raw_buffer_ = journal_lock_.data();
     journal_body_ = journal_raw_buffer_ + sizeof(journal_header_t);
     journal_header_ = (journal_header_t*)journal_raw_buffer_;
-    journal_header_cow_ = (journal_header_t*)(parent_fs_governor->file_.data() + journal_end_ * block_size_ - sizeof(journal_header_t));
+    journal_header_cow_ = (journal_header_t*)(journal_lock_.data() + journal_lock_.size() - sizeof(journal_header_t));
     *(uint64_t*)&capacity_ = (journal_end_ - journal_start_) * block_size_ - (sizeof(journal_header_t) * 2);
-}
-
-cfs::cfs_journaling_t::~cfs_journaling_t()
-{
-    for (auto i = parent_fs_governor_->static_info_.journal_start;
-        i < parent_fs_governor_->static_info_.journal_end; i++)
+    staged_ = std::make_unique<cfs_action_t[]>(staging_slots);
+    staged_sequence_ = std::make_unique<std::atomic<uint64_t>[]>(staging_slots);
+    cfs_assert_simple(capacity_ % sizeof(cfs_action_t) == 0);
+
+    // continue where the last mount stopped. the header is written next to the records, not in step with them
+    // on disk, so head, tail and size are taken from where the newest record actually sits
+    const auto [newest_slot_index, newest] = newest_slot();
+    if (newest == 0)
+    {
+        // nothing readable, whatever is left is torn or from an older format
+        journal_header_->head = journal_header_->tail = journal_header_->size = 0;
+    }
+    else if (const uint64_t head = (newest_slot_index + 1) * sizeof(cfs_action_t) % capacity_; head != journal_header_->head)
     {
-        parent_fs_governor_->bitlocker_.unlock(i);
+        // an older record after the newest one means the ring went round at least once,
+        // the slot right after it may be the one torn by the crash
+        const bool wrapped = valid_slot_from(head / sizeof(cfs_action_t), capacity_ / sizeof(cfs_action_t))
+            != capacity_ / sizeof(cfs_action_t);
+        journal_header_->head = head;
+        journal_header_->tail = wrapped ? head : 0;
+        journal_header_->size = wrapped ? capacity_ : head;
     }
+
+    next_sequence_ = newest + 1;
+    written_ = newest + 1;
 }
 
 std::vector<cfs::cfs_action_t> cfs::cfs_journaling_t::dump_actions()
 {
-    std::lock_guard<std::mutex> guard(mutex_);
     std::vector < cfs_action_t > actions;
-    auto data = dump();
-    for (uint64_t i = 0; i < data.size();)
-    {
-        if (const auto * action = reinterpret_cast<cfs_action_t *>(data.data() + i);
-            action->cfs_magic == cfs_magick_number)
-        {
-            actions.push_back(*action);
-            i += sizeof(cfs_action_t);
-        } else {
-            i++;
-        }
-    }
-
+    for_each_action(0, [&](const cfs_action_t & action) { actions.push_back(action); });
     return actions;
 }
 
-void cfs::cfs_journaling_t::push_action(
+uint64_t cfs::cfs_journaling_t::replayed_sequence()
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    return journal_header_->replayed;
+}
+
+void cfs::cfs_journaling_t::set_replayed_sequence(const uint64_t sequence)
+{
+    std::lock_guard<std::mutex> guard(mutex_);
+    journal_header_->replayed = sequence;
+}
+
+uint64_t cfs::cfs_journaling_t::push_action(
     const uint64_t action,
     const uint64_t action_param0,
     const uint64_t action_param1,
@@ -77,9 +148,12 @@ void cfs::cfs_journaling_t::push_action(
     const uint64_t action_param3,
     const uint64_t action_param4)
 {
-    std::lock_guard<std::mutex> guard(mutex_);
+    const uint64_t sequence = next_sequence_.fetch_add(1);
     cfs_action_t j_action = { };
-    j_action.cfs_magic = cfs_magick_number;
+    j_action.cfs_magic = cfs_journal_record_magic;
+    j_action.version = cfs_journal_record_version;
+    j_action.length = sizeof(cfs_action_t);
+    j_action.sequence = sequence;
     j_action.action_data.action_plain = {
         .action = action,
         .action_param0 = action_param0,
@@ -88,10 +162,63 @@ void cfs::cfs_journaling_t::push_action(
         .action_param3 = action_param3,
         .action_param4 = action_param4,
     };
-    j_action.action_param_crc64 = cfs::utils::arithmetic::hash64((uint8_t*)&j_action.action_data, sizeof(j_action.action_data));
-    *journal_header_cow_ = *journal_header_;
-    for (int i = 0; i < sizeof(j_action); i++) {
-        putc(reinterpret_cast<const char *>(&j_action)[i]);
+    j_action.record_crc32 = CRC32::C::calc(reinterpret_cast<const uint8_t *>(&j_action.sequence),
+        sizeof(cfs_action_t) - offsetof(cfs_action_t, sequence));
+
+    // wait for a free slot, it is freed once the action staging_slots ahead of us is written
+    for (uint64_t written = written_.load(); sequence - written >= staging_slots; written = written_.load()) {
+        written_.wait(written);
+    }
+
+    const uint64_t slot = sequence % staging_slots;
+    staged_[slot] = j_action;
+    staged_sequence_[slot].store(sequence + 1);
+
+    // commit it ourselves, unless someone is committing already and will pick it up
+    while (!committing_.exchange(true))
+    {
+        drain_staged();
+        committing_.store(false);
+
+        // an action published while we were draining finds committing_ taken and counts on us, recheck
+        if (const uint64_t written = written_.load(); staged_sequence_[written % staging_slots].load() != written + 1) {
+            break;
+        }
+    }
+
+    for (uint64_t written = written_.load(); written <= sequence; written = written_.load()) {
+        written_.wait(written);
+    }
+
+    return sequence;
+}
+
+void cfs::cfs_journaling_t::drain_staged()
+{
+    while (true)
+    {
+        const uint64_t begin = written_.load(std::memory_order_relaxed);
+        uint64_t end = begin;
+        while (end - begin < staging_slots && staged_sequence_[end % staging_slots].load() == end + 1) {
+            end++;
+        }
+
+        if (end == begin) {
+            return; // next action is not published yet, its own thread commits it
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            *journal_header_cow_ = *journal_header_;
+            // a run wraps around the staging ring at most once
+            const uint64_t first = begin % staging_slots;
+            const uint64_t before_wrap = std::min(end - begin, staging_slots - first);
+            write(staged_.get() + first, before_wrap * sizeof(cfs_action_t));
+            write(staged_.get(), (end - begin - before_wrap) * sizeof(cfs_action_t));
+        }
+
+        written_.store(end);
+        written_.notify_all();
     }
 }
 
@@ -121,80 +248,381 @@ cfs::cfs_bitmap_block_mirroring_t::cfs_bitmap_block_mirroring_t(cfs::filesystem
     parent_fs_governor_(parent_fs_governor),
     journal_(journal)
 {
+    rebuild_summary();
+}
+
+/// checksum contribution of one set bit. a page checksum is the sum over its set bits, so a flip
+/// adds or subtracts one term instead of rehashing the page
+static uint64_t bit_signature(uint64_t index)
+{
+    // splitmix64 finalizer
+    index += 0x9e3779b97f4a7c15ull;
+    index = (index ^ (index >> 30)) * 0xbf58476d1ce4e5b9ull;
+    index = (index ^ (index >> 27)) * 0x94d049bb133111ebull;
+    return index ^ (index >> 31);
+}
+
+std::pair<uint32_t, uint64_t> cfs::cfs_bitmap_block_mirroring_t::scan_page(const uint64_t page) const
+{
+    // padding bits after the last particle are always cleared, so only set bits are counted
+    const auto particles = parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start;
+    const auto bits_per_page = parent_fs_governor_->static_info_.block_size * 8;
+    const auto * map = static_cast<const uint8_t *>(mirror1.data());
+    const auto bits = std::min(bits_per_page, particles - page * bits_per_page);
+    const auto offset = page * parent_fs_governor_->static_info_.block_size;
+    const auto bytes = (bits + 7) / 8;
+    uint64_t set_bits = 0;
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < bytes; i += sizeof(uint64_t))
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, map + offset + i, std::min<uint64_t>(sizeof(uint64_t), bytes - i));
+        set_bits += std::popcount(word);
+        for (; word != 0; word &= word - 1) {
+            checksum += bit_signature((offset + i) * 8 + std::countr_zero(word));
+        }
+    }
+
+    return { static_cast<uint32_t>(bits - set_bits), checksum };
+}
+
+void cfs::cfs_bitmap_block_mirroring_t::rebuild_summary()
+{
+    const auto particles = parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start;
+    const auto bits_per_page = parent_fs_governor_->static_info_.block_size * 8;
+
+    pages_ = (particles + bits_per_page - 1) / bits_per_page;
+    page_free_bits_.assign(pages_, 0);
+    page_checksums_.assign(pages_, 0);
+    pages_with_free_bits_ = std::make_unique<std::atomic<uint64_t>[]>((pages_ + 63) / 64);
+    dirty_pages_ = std::make_unique<std::atomic_bool[]>(pages_);
+    uncommitted_pages_ = std::make_unique<std::atomic_bool[]>(pages_);
+    const auto page_size = parent_fs_governor_->static_info_.block_size;
+    auto * map1 = static_cast<uint8_t *>(mirror1.data());
+    const auto * map2 = static_cast<const uint8_t *>(mirror2.data());
+    uint64_t free_bits = 0;
+    uint64_t merged = 0;
+    for (uint64_t page = 0; page < pages_; page++)
+    {
+        // page checksums only live in memory, so the mirrors are the only check of what is on disk.
+        // they differ where mirror2 lagged behind at a crash, or where either got damaged. a bit set in
+        // either mirror is kept set: at worst a block leaks until fsck, but it is never handed out twice
+        const auto offset = page * page_size;
+        const auto size = std::min<uint64_t>(page_size, mirror1.size() - offset);
+        if (std::memcmp(map1 + offset, map2 + offset, size) != 0)
+        {
+            for (uint64_t i = 0; i < size; i++) {
+                map1[offset + i] |= map2[offset + i];
+            }
+
+            uncommitted_pages_[page] = true; // next commit brings mirror2 up to the merged page
+            merged++;
+        }
+
+        // the bitmap kept by the root can be older than this mount, so the next root takes every page
+        dirty_pages_[page] = true;
+
+        std::tie(page_free_bits_[page], page_checksums_[page]) = scan_page(page);
+        if (page_free_bits_[page] != 0) {
+            pages_with_free_bits_[page / 64] |= 1ull << (page % 64);
+        }
+        free_bits += page_free_bits_[page];
+    }
+
+    if (merged != 0) {
+        wlog("Filesystem bitmap mirrors differ in ", merged, " page(s), merged\n");
+    }
+
+    free_bits_ = free_bits;
+}
+
+uint64_t cfs::cfs_bitmap_block_mirroring_t::next_page_with_free_bits(const uint64_t page) const
+{
+    for (uint64_t word = page / 64; word < (pages_ + 63) / 64; word++)
+    {
+        const uint64_t pages = pages_with_free_bits_[word].load(std::memory_order_relaxed)
+            & (word == page / 64 ? ~0ull << (page % 64) : ~0ull);
+        if (pages != 0) {
+            return word * 64 + std::countr_zero(pages);
+        }
+    }
+
+    return pages_;
 }
 
 bool cfs::cfs_bitmap_block_mirroring_t::get_bit(const uint64_t index)
 {
     cfs_assert_simple(index < (parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start))
-    // huge multipage state lock (really slow, so it'd better be in cache pool)
+    return mirror1.get_bit(index);
+}
+
+void cfs::cfs_bitmap_block_mirroring_t::set_bit(const uint64_t index, const bool new_bit)
+{
+    cfs_assert_simple(index < (parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start))
+
+    // a bit flip only ever holds its own bitmap page, writers on other pages don't wait on it
+    const auto page_bare = index / (parent_fs_governor_->static_info_.block_size * 8);
+    auto lock = parent_fs_governor_->lock(parent_fs_governor_->static_info_.data_bitmap_start + page_bare);
+    set_bit_unblocked(index, mirror1.get_bit(index), new_bit);
+}
+
+bool cfs::cfs_bitmap_block_mirroring_t::test_and_set_bit(const uint64_t index)
+{
+    cfs_assert_simple(index < (parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start))
+
+    // a bit already set is lost anyway, find that out without the page lock
+    if (mirror1.get_bit(index)) {
+        return false;
+    }
+
+    // test and set under the page lock, so two allocators can't both see the same cleared bit
+    const auto page_bare = index / (parent_fs_governor_->static_info_.block_size * 8);
+    auto lock = parent_fs_governor_->lock(parent_fs_governor_->static_info_.data_bitmap_start + page_bare);
+    if (mirror1.get_bit(index)) {
+        return false;
+    }
+
+    set_bit_unblocked(index, false, true);
+    return true;
+}
+
+uint64_t cfs::cfs_bitmap_block_mirroring_t::find_first_zero(uint64_t start, const uint64_t end)
+{
+    cfs_assert_simple(start <= end && end <= (parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start))
+    // bits are LSB first in every byte, so on a little endian host a 64bit load puts bit n of the word at index word * 64 + n
+    static_assert(std::endian::native == std::endian::little, "word scan assumes a little endian host");
+
+    const auto bits_per_page = parent_fs_governor_->static_info_.block_size * 8;
+    const auto * map = static_cast<const uint8_t *>(mirror1.data());
+    const auto map_bytes = mirror1.size();
+
+    while (start < end)
+    {
+        // skip pages the summary knows are full
+        const auto page_bare = next_page_with_free_bits(start / bits_per_page);
+        if (page_bare != start / bits_per_page)
+        {
+            start = std::max(start, page_bare * bits_per_page);
+            continue;
+        }
+
+        const auto page_end = std::min(end, (page_bare + 1) * bits_per_page);
+        const auto lock = parent_fs_governor_->lock_shared(parent_fs_governor_->static_info_.data_bitmap_start + page_bare);
+        while (start < page_end)
+        {
+            const uint64_t word_offset = start / 64 * 8;
+            uint64_t word = 0;
+            std::memcpy(&word, map + word_offset, std::min<uint64_t>(sizeof(uint64_t), map_bytes - word_offset));
+
+            // cleared bits at or after start
+            if (const uint64_t free_bits = ~word & (~0ull << (start % 64)); free_bits != 0)
+            {
+                // padding bits past the end of the bitmap read as cleared, hence the bound check
+                const uint64_t found = start / 64 * 64 + std::countr_zero(free_bits);
+                return found < end ? found : end;
+            }
+
+            start = start / 64 * 64 + 64;
+        }
+    }
+
+    return end;
+}
+
+void cfs::cfs_bitmap_block_mirroring_t::set_bit_unblocked(const uint64_t index, const bool original, const bool new_bit)
+{
     const auto page_bare = index / (parent_fs_governor_->static_info_.block_size * 8);
-    const auto bitmap_01 = parent_fs_governor_->static_info_.data_bitmap_start + page_bare;
-    const auto bitmap_02 = parent_fs_governor_->static_info_.data_bitmap_backup_start + page_bare;
-    bool map1, map2;
+    mirror1.set_bit(index, new_bit);
+    dirty_pages_[page_bare] = true;
+    uncommitted_pages_[page_bare] = true;
+    if (original != new_bit) {
+        update_summary(page_bare, index, new_bit);
+    }
+}
+
+void cfs::cfs_bitmap_block_mirroring_t::update_summary(const uint64_t page, const uint64_t index, const bool new_bit)
+{
+    if (new_bit)
+    {
+        free_bits_--;
+        page_checksums_[page] += bit_signature(index);
+        if (--page_free_bits_[page] == 0) {
+            pages_with_free_bits_[page / 64] &= ~(1ull << (page % 64));
+        }
+    }
+    else
+    {
+        free_bits_++;
+        page_checksums_[page] -= bit_signature(index);
+        if (page_free_bits_[page]++ == 0) {
+            pages_with_free_bits_[page / 64] |= 1ull << (page % 64);
+        }
+    }
+}
+
+uint64_t cfs::cfs_bitmap_block_mirroring_t::claim_range(const uint64_t start, const uint64_t max_count)
+{
+    const auto particles = parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start;
+    cfs_assert_simple(start < particles)
+
+    // runs stop at the page end, so a claim holds one bitmap page like any other bit flip
+    const auto bits_per_page = parent_fs_governor_->static_info_.block_size * 8;
+    const auto page_bare = start / bits_per_page;
+    const auto end = std::min({ start + max_count, particles, (page_bare + 1) * bits_per_page });
+    auto lock = parent_fs_governor_->lock(parent_fs_governor_->static_info_.data_bitmap_start + page_bare);
+    uint64_t count = 0;
+    while (start + count < end && !mirror1.get_bit(start + count)) {
+        count++;
+    }
+
+    for (uint64_t i = start; i < start + count; i++)
     {
-        auto lock1 = parent_fs_governor_->lock(bitmap_01);
-        auto lock2 = parent_fs_governor_->lock(bitmap_02);
-        map1 = mirror1.get_bit(index, false);
-        map2 = mirror2.get_bit(index, false);
+        mirror1.set_bit(i, true);
+        update_summary(page_bare, i, true);
     }
-    if (map1 != map2)
+
+    if (count != 0)
+    {
+        dirty_pages_[page_bare] = true;
+        uncommitted_pages_[page_bare] = true;
+    }
+
+    return count;
+}
+
+uint64_t cfs::cfs_bitmap_block_mirroring_t::commit()
+{
+    std::lock_guard lock(dump_mutex_);
+    last_commit_ = utils::get_timestamp();
+    const auto page_size = parent_fs_governor_->static_info_.block_size;
+    auto * map1 = static_cast<uint8_t *>(mirror1.data());
+    auto * map2 = static_cast<uint8_t *>(mirror2.data());
+    uint64_t merged = 0;
+    for (uint64_t page = 0; page < pages_; page++)
     {
-        elog("Filesystem bitmap corrupted at runtime, fsck needed!\n");
+        // flag is dropped before the copy, a flip racing with the copy marks the page again
+        if (!uncommitted_pages_[page].exchange(false)) {
+            continue;
+        }
+
+        const auto offset = page * page_size;
+        const auto size = std::min<uint64_t>(page_size, mirror1.size() - offset);
+        const auto lock1 = parent_fs_governor_->lock(parent_fs_governor_->static_info_.data_bitmap_start + page);
+        const auto lock2 = parent_fs_governor_->lock(parent_fs_governor_->static_info_.data_bitmap_backup_start + page);
+        if (scan_page(page).second == page_checksums_[page]) {
+            std::memcpy(map2 + offset, map1 + offset, size);
+            continue;
+        }
+
+        // something other than a bit flip wrote this page. mirror2 misses the flips since the last commit,
+        // so neither can be trusted alone. a bit set in either is kept set, as on mount: at worst a block
+        // leaks until fsck, but one in use is never handed out again
+        elog("Filesystem bitmap page ", page, " failed its checksum, merging with mirror\n");
         journal_->push_action(CorruptionDetected, BitmapMirrorInconsistent);
-        elog("Cannot recover from fatal fault\n");
-        throw cfs::error::filesystem_head_corrupt_and_unable_to_recover();
+        for (uint64_t i = 0; i < size; i++) {
+            map1[offset + i] |= map2[offset + i];
+        }
+        std::memcpy(map2 + offset, map1 + offset, size);
+        const auto [free_bits, checksum] = scan_page(page);
+        free_bits_ += free_bits;
+        free_bits_ -= page_free_bits_[page];
+        page_free_bits_[page] = free_bits;
+        page_checksums_[page] = checksum;
+        if (free_bits != 0) {
+            pages_with_free_bits_[page / 64] |= 1ull << (page % 64);
+        } else {
+            pages_with_free_bits_[page / 64] &= ~(1ull << (page % 64));
+        }
+        dirty_pages_[page] = true;
+        journal_->push_action(AttemptedFixFinishedAndAssumedFine, BitmapMirrorInconsistent);
+        merged++;
     }
 
-    // small_cache_.set_fast_cache(index, map1);
-    return map1;
+    return merged;
 }
 
-void cfs::cfs_bitmap_block_mirroring_t::set_bit(const uint64_t index, const bool new_bit)
+void cfs::cfs_bitmap_block_mirroring_t::commit_periodically()
 {
-    cfs_assert_simple(index < (parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start))
+    if (utils::get_timestamp() - last_commit_ >= commit_interval) {
+        (void)commit();
+    }
+}
+
+std::vector<uint8_t> cfs::cfs_bitmap_block_mirroring_t::dump()
+{
+    std::lock_guard lock(dump_mutex_);
+    const auto lock_pages = parent_fs_governor_->lock_continuous(parent_fs_governor_->static_info_.data_bitmap_start, pages_, true);
+    std::vector<uint8_t> ret;
+    ret.resize(mirror1.size());
+    std::memcpy(ret.data(), mirror1.data(), mirror1.size());
+    return ret;
+}
 
+cfs::cfs_bitmap_block_mirroring_t::dirty_pages_t cfs::cfs_bitmap_block_mirroring_t::dump_dirty_pages(const bool all)
+{
     std::lock_guard lock(dump_mutex_);
-    bool success = false;
-    const auto original = this->get_bit(index);
-    g_transaction(journal_, success, FilesystemBitmapModification, original, new_bit, index);
-    const auto page_bare = index / (parent_fs_governor_->static_info_.block_size * 8);
-    const auto bitmap_01 = parent_fs_governor_->static_info_.data_bitmap_start + page_bare;
-    const auto bitmap_02 = parent_fs_governor_->static_info_.data_bitmap_backup_start + page_bare;
-    auto lock1 = parent_fs_governor_->lock(bitmap_01);
-    auto lock2 = parent_fs_governor_->lock(bitmap_02);
-    mirror1.set_bit(index, new_bit, false);
-    mirror2.set_bit(index, new_bit, false);
-    success = true;
+    const auto page_size = parent_fs_governor_->static_info_.block_size;
+    dirty_pages_t ret;
+    for (uint64_t page = 0; page < pages_; page++)
+    {
+        // flag is dropped before the copy, a flip racing with the copy marks the page again
+        if (!dirty_pages_[page].exchange(false) && !all) {
+            continue;
+        }
+
+        const auto offset = page * page_size;
+        const auto size = std::min<uint64_t>(page_size, mirror1.size() - offset);
+        std::vector<uint8_t> data(size);
+        const auto lock1 = parent_fs_governor_->lock_shared(parent_fs_governor_->static_info_.data_bitmap_start + page);
+        std::memcpy(data.data(), static_cast<const uint8_t *>(mirror1.data()) + offset, size);
+        ret.emplace_back(page, std::move(data));
+    }
+
+    return ret;
 }
 
 cfs::cfs_block_attribute_access_t::cfs_block_attribute_access_t(filesystem *parent_fs_governor,
-    cfs_journaling_t *journal): parent_fs_governor_(parent_fs_governor), journal_(journal)
+    cfs_journaling_t *journal): parent_fs_governor_(parent_fs_governor), journal_(journal),
+    table_(reinterpret_cast<uint32_t *>(parent_fs_governor->file_.data()
+        + parent_fs_governor->static_info_.data_block_attribute_table_start * parent_fs_governor->static_info_.block_size)),
+    blocks_(parent_fs_governor->static_info_.data_table_end - parent_fs_governor->static_info_.data_table_start)
 {
-    *(uint64_t*)&location_lock_.blocks_ = parent_fs_governor->static_info_.data_table_end - parent_fs_governor->static_info_.data_table_start;
-    location_lock_.init();
+    cfs_assert_simple(blocks_ * sizeof(uint32_t) <= (parent_fs_governor->static_info_.data_block_attribute_table_end
+        - parent_fs_governor->static_info_.data_block_attribute_table_start) * parent_fs_governor->static_info_.block_size);
 }
 
-cfs::cfs_block_attribute_access_t::smart_lock_t::smart_lock_t(
-    cfs_block_attribute_access_t *parent,
-    const uint64_t index)
-:
-    parent_(parent), index_(index)
+void cfs::cfs_block_attribute_access_t::after_change(const uint64_t index,
+    const cfs_block_attribute_t & before, const cfs_block_attribute_t & after)
 {
-    parent->location_lock_.lock(index);
-    const auto offset = index * sizeof(cfs_block_attribute_t);
-    const auto in_page_offset = offset % parent->parent_fs_governor_->static_info_.block_size;
-    const auto page = offset / parent->parent_fs_governor_->static_info_.block_size +
-                      parent->parent_fs_governor_->static_info_.data_block_attribute_table_start;
-    cfs_assert_simple(parent->parent_fs_governor_->static_info_.data_block_attribute_table_start <= page
-        && page < parent->parent_fs_governor_->static_info_.data_block_attribute_table_end);
-    const auto pg_data = parent->parent_fs_governor_->lock(page);
-    data_ = (cfs_block_attribute_t*)(void*)(pg_data.data() + in_page_offset);
-    before_ = *data_;
+    if (after.block_type == COW_REDUNDANCY_BLOCK && before.block_type != COW_REDUNDANCY_BLOCK) {
+        parent_fs_governor_->cfs_header_block.dec<allocated_non_cow_blocks>();
+    } else if (after.block_type != COW_REDUNDANCY_BLOCK && before.block_type == COW_REDUNDANCY_BLOCK) {
+        parent_fs_governor_->cfs_header_block.inc<allocated_non_cow_blocks>();
+    }
+
+    const bool retired = after.block_type == COW_REDUNDANCY_BLOCK && before.block_type != COW_REDUNDANCY_BLOCK;
+    const bool released = after.index_node_referencing_number == 0 && before.index_node_referencing_number != 0;
+    if ((retired || released) && reclaimable_hook_) {
+        reclaimable_hook_(index);
+    }
 }
 
-cfs::cfs_block_attribute_access_t::smart_lock_t::~smart_lock_t()
+thread_local cfs::journal_auto_write_t * cfs::journal_auto_write_t::current_ = nullptr;
+
+/// nested transactions whose parameters name blocks, replay needs them to undo an interrupted outermost one
+static bool names_blocks(const uint64_t type)
 {
-    parent_->location_lock_.unlock(index_);
+    switch (type)
+    {
+        case cfs::FilesystemBitmapModification:
+        case cfs::FilesystemBitmapRangeModification:
+        case cfs::GlobalTransaction_CreateRedundancy:
+        case cfs::GlobalTransaction_DeallocateBlock:
+        case cfs::GlobalTransaction_OverwriteInPlace:
+            return true;
+        default:
+            return false;
+    }
 }
 
 cfs::journal_auto_write_t::journal_auto_write_t(cfs_journaling_t *journal, bool &success,
@@ -219,6 +647,8 @@ cfs::journal_auto_write_t::journal_auto_write_t(cfs_journaling_t *journal, bool
     const uint64_t failed_action_param3,
     const uint64_t failed_action_param4): 
 journal_(journal), success_(success),
+previous_(current_),
+parent_(previous_ != nullptr && previous_->journal_ == journal ? previous_ : nullptr),
 success_action_(success_action),
 
 // success
@@ -236,17 +666,53 @@ failed_action_param2_(failed_action_param2),
 failed_action_param3_(failed_action_param3),
 failed_action_param4_(failed_action_param4)
 {
-    journal_->push_action(
-        start_action,
-        start_action_param0,
-        start_action_param1,
-        start_action_param2,
-        start_action_param3,
-        start_action_param4);
+    // param4 carries the sub-action count, or the outermost start sequence of a nested record
+    cfs_assert_simple(start_action_param4 == 0 && success_action_param4_ == 0 && failed_action_param4_ == 0);
+
+    current_ = this;
+    if (parent_ == nullptr)
+    {
+        outermost_sequence_ = journal_->push_action(
+            start_action,
+            start_action_param0,
+            start_action_param1,
+            start_action_param2,
+            start_action_param3,
+            start_action_param4);
+        return;
+    }
+
+    outermost_sequence_ = parent_->outermost_sequence_;
+    if (start_action == GlobalTransaction && names_blocks(start_action_param0)) {
+        journal_->push_action(
+            NestedTransaction,
+            start_action_param0,
+            start_action_param1,
+            start_action_param2,
+            start_action_param3,
+            outermost_sequence_);
+    }
 }
 
 cfs::journal_auto_write_t::~journal_auto_write_t()
 {
+    current_ = previous_;
+    if (parent_ != nullptr)
+    {
+        // nested, the outermost transaction speaks for us unless we failed
+        if (!success_ && failed_action_ == GlobalTransaction) {
+            journal_->push_action(
+                NestedTransaction,
+                failed_action_param0_,
+                failed_action_param1_,
+                failed_action_param2_,
+                failed_action_param3_,
+                outermost_sequence_);
+        }
+        parent_->sub_actions_ += sub_actions_ + 1;
+        return;
+    }
+
     if (success_) {
         journal_->push_action(
             success_action_,
@@ -254,7 +720,7 @@ cfs::journal_auto_write_t::~journal_auto_write_t()
             success_action_param1_,
             success_action_param2_,
             success_action_param3_,
-            success_action_param4_);
+            sub_actions_);
     } else {
         journal_->push_action(
             failed_action_,
@@ -262,126 +728,872 @@ cfs::journal_auto_write_t::~journal_auto_write_t()
             failed_action_param1_,
             failed_action_param2_,
             failed_action_param3_,
-            failed_action_param4_);
+            sub_actions_);
     }
 }
 
-cfs::cfs_block_manager_t::cfs_block_manager_t(
-    cfs_bitmap_block_mirroring_t *bitmap,
-    filesystem::cfs_header_block_t *header,
-    cfs_block_attribute_access_t *block_attribute,
-    cfs_journaling_t *journal)
-: bitmap_(bitmap), header_(header), block_attribute_(block_attribute), journal_(journal)
-{
-}
-
-uint64_t cfs::cfs_block_manager_t::allocate()
+cfs::cfs_journal_replay_t::report_t cfs::cfs_journal_replay_t::replay(const bool apply)
 {
-    const auto static_info = header_->get_static_info();
-    const auto map_size = static_info.data_table_end - static_info.data_table_start;
-    bool operation_success = true;
-    g_transaction(journal_, operation_success, GlobalTransaction_AllocateBlock);
-
-    auto allocate_at_this_index = [&](const uint64_t index)
+    // types written with closing records
+    auto is_start = [](const uint64_t type)->bool
     {
-        bitmap_->set_bit(index, true);
-        block_attribute_->clear(index, {
-            .block_status = BLOCK_AVAILABLE_TO_MODIFY_0x00,
-            .block_type = COW_REDUNDANCY_BLOCK,
-            .block_type_cow = 0,
-            .allocation_oom_scan_per_refresh_count = 0,
-            .index_node_referencing_number = 1,
-            .block_checksum = 0
-        });
+        switch (type)
+        {
+            case FilesystemBitmapModification:
+            case FilesystemBitmapRangeModification:
+            case GlobalTransaction_AllocateBlock:
+            case GlobalTransaction_DeallocateBlock:
+            case GlobalTransaction_CreateRedundancy:
+            case GlobalTransaction_OverwriteInPlace:
+            case GlobalTransaction_AllocateRange:
+            case GlobalTransaction_ReclaimRedundancy:
+            case GlobalTransaction_Major_WriteInode:
+            case GlobalTransaction_Major_ResizeInode:
+            case GlobalTransaction_Major_InodeMetadataModification:
+            case GlobalTransaction_Major_SnapshotCreation:
+            case GlobalTransaction_Major_SnapshotRevert:
+            case GlobalTransaction_Major_SnapshotDeletion:
+                return true;
+            default:
+                return false;
+        }
     };
 
-    auto refresh_allocate = [&](bool & success, const uint64_t start, const uint64_t end)
+    // open transactions, keyed by type and the parameters start and closing record share.
+    // closing records are type + 1 (_Completed) or type + 2 (_Failed)
+    report_t report;
+    using key_t = std::array < uint64_t, 4 >;
+    std::map < key_t, std::deque < cfs_action_t > > open;
+    std::map < uint64_t, std::vector < cfs_action_t > > nested; // outermost start sequence -> nested records
+    journal_->for_each_action(journal_->replayed_sequence() + 1, [&](const cfs_action_t & action)
     {
-        /// start from 0
-        for (uint64_t i = start; i < end; ++i)
+        report.scanned++;
+        const auto & plain = action.action_data.action_plain;
+        if (plain.action == NestedTransaction) {
+            nested[plain.action_param4].push_back(action);
+            return;
+        }
+
+        if (plain.action != GlobalTransaction) {
+            return;
+        }
+
+        key_t key = { plain.action_param0, plain.action_param1, plain.action_param2, plain.action_param3 };
+        if (is_start(key[0]))
         {
-            if (!bitmap_->get_bit(i)) {
-                /// get one
-                /// record last allocated position
-                header_->set_info<last_allocated_block>(i);
-                // allocate
-                allocate_at_this_index(i);
-                success = true;
-                return i;
+            open[key].push_back(action);
+            return;
+        }
+
+        for (const uint64_t distance : { 1, 2 })
+        {
+            key[0] = plain.action_param0 - distance;
+            if (const auto it = open.find(key); it != open.end())
+            {
+                it->second.pop_front();
+                if (it->second.empty()) {
+                    open.erase(it);
+                }
+                return;
             }
         }
+    });
 
-        success = false;
-        return 0ul;
+    std::vector < cfs_action_t > interrupted;
+    for (const auto & starts : open | std::views::values) {
+        interrupted.insert(interrupted.end(), starts.begin(), starts.end());
+    }
+    std::ranges::sort(interrupted, {}, &cfs_action_t::sequence);
+
+    const std::vector < cfs_action_t > none;
+    for (const auto & start : interrupted)
+    {
+        report.interrupted++;
+        const auto it = nested.find(start.sequence);
+        switch (resolve(start, it == nested.end() ? none : it->second, apply))
+        {
+            case -1: report.rolled_back++; break;
+            case 1: report.rolled_forward++; break;
+            default: report.unresolved.push_back(start); break;
+        }
+    }
+
+    if (apply)
+    {
+        const uint64_t marker = journal_->push_action(JournalReplayed, report.interrupted, report.rolled_back, report.rolled_forward);
+        journal_->set_replayed_sequence(marker);
+    }
+
+    return report;
+}
+
+tsl::hopscotch_set < uint64_t > cfs::cfs_journal_replay_t::linked_blocks(const uint64_t inode) const
+{
+    const uint64_t blocks = block_attribute_->blocks();
+    const uint64_t block_size = parent_fs_governor_->static_info_.block_size;
+    const uint64_t pointers_per_block = block_size / sizeof(uint64_t);
+    auto read_pointers = [&](const uint64_t index)->std::vector < uint64_t >
+    {
+        std::vector < uint64_t > pointers(pointers_per_block);
+        const auto lock = parent_fs_governor_->lock_shared(index + parent_fs_governor_->static_info_.data_table_start);
+        std::memcpy(pointers.data(), lock.data(), block_size);
+        return pointers;
     };
 
-    auto fully_allocate_by_running_through = [&]->uint64_t
+    auto inode_data = read_pointers(inode);
+    cfs_inode_t inode_block;
+    inode_block.convert(reinterpret_cast<char *>(inode_data.data()), block_size);
+    const uint64_t level3 = utils::arithmetic::count_cell_with_cell_size(block_size, inode_block.cfs_inode_attribute->st_size);
+    const uint64_t level2 = utils::arithmetic::count_cell_with_cell_size(pointers_per_block, level3);
+    const uint64_t level1 = utils::arithmetic::count_cell_with_cell_size(pointers_per_block, level2);
+    if (level1 > inode_block.cfs_level_1_index_numbers) {
+        return { };
+    }
+
+    // the same walk as reading the tree from disk, pointers out of range are a damaged tree and left to fsck
+    tsl::hopscotch_set < uint64_t > linked;
+    std::vector < uint64_t > upper(inode_block.cfs_level_1_indexes, inode_block.cfs_level_1_indexes + level1);
+    for (const uint64_t wanted : { level2, level3, uint64_t(0) })
     {
-        bool success;
-        if (const uint64_t ret = refresh_allocate(success, 0, map_size); !success)
+        std::vector < uint64_t > lower;
+        for (const uint64_t pointer : upper)
         {
-            // not found
-            /// Record OOM refresh
-            for (uint64_t i = 0; i < map_size; ++i)
-            {
-                if (bitmap_->get_bit(i)) {
-                    block_attribute_->inc<allocation_oom_scan_per_refresh_count>(i);
-                }
+            if (pointer >= blocks) {
+                continue;
             }
 
-            /// deallocate oldest redundancies
-            uint64_t oldest = 0;
-            std::map < uint64_t, uint64_t > scanned_cow_blocks;
-            for (uint64_t i = 0; i < map_size; ++i)
+            linked.insert(pointer);
+            if (lower.size() < wanted)
             {
-                if (bitmap_->get_bit(i))
-                {
-                    if (const auto attr = block_attribute_->get(i);
-                        attr.block_type == CowRedundancy || attr.index_node_referencing_number == 0)
-                    {
-                        const auto refresh = block_attribute_->get<allocation_oom_scan_per_refresh_count>(i);
-                        if (oldest < refresh) oldest = refresh;
-                        scanned_cow_blocks[i] = refresh;
-                    }
+                const auto pointers = read_pointers(pointer);
+                const auto length = std::min(pointers_per_block, wanted - lower.size());
+                lower.insert(lower.end(), pointers.begin(), pointers.begin() + static_cast<int64_t>(length));
+            }
+        }
+
+        upper = std::move(lower);
+    }
+
+    return linked;
+}
+
+int cfs::cfs_journal_replay_t::resolve(const cfs_action_t & start, const std::vector < cfs_action_t > & nested, const bool apply)
+{
+    const auto & plain = start.action_data.action_plain;
+    const uint64_t blocks = block_attribute_->blocks();
+    auto retire = [&](const uint64_t index)
+    {
+        if (apply) {
+            block_attribute_->move<block_type, block_type_cow>(index); // backup block type
+            block_attribute_->set<block_type>(index, COW_REDUNDANCY_BLOCK); // reclaimer frees it
+        }
+    };
+
+    auto restore = [&](const uint64_t index)
+    {
+        if (apply) {
+            block_attribute_->move<block_type_cow, block_type>(index); // take back the type retiring backed up
+        }
+    };
+
+    auto exclusive = [&](const uint64_t index)->bool
+    {
+        const auto attr = block_attribute_->get(index);
+        return attr.block_status == BLOCK_AVAILABLE_TO_MODIFY_0x00 && attr.index_node_referencing_number <= 1;
+    };
+
+    auto block_crc = [&](const uint64_t index)->uint64_t
+    {
+        const auto lock = parent_fs_governor_->lock_shared(index + parent_fs_governor_->static_info_.data_table_start);
+        return utils::arithmetic::hash64(reinterpret_cast<const uint8_t *>(lock.data()), lock.size());
+    };
+
+    // a before-image is live until the write retires it
+    auto live = [&](const uint64_t index)->bool {
+        return bitmap_->get_bit(index) && block_attribute_->get<block_type>(index) != COW_REDUNDANCY_BLOCK;
+    };
+
+    // blocks the nested records claimed from the bitmap, copies they made, blocks they released,
+    // and before-images of blocks they overwrote in place
+    std::vector < uint64_t > claimed, released;
+    std::vector < std::pair < uint64_t, uint64_t > > copies; // original -> copy
+    std::vector < std::array < uint64_t, 3 > > overwrites; // [block, before-image, CRC64 of before-image]
+    for (const auto & action : nested)
+    {
+        const auto & record = action.action_data.action_plain;
+        switch (record.action_param0)
+        {
+            case FilesystemBitmapModification:
+                if (!record.action_param1 && record.action_param2 && record.action_param3 < blocks) {
+                    claimed.push_back(record.action_param3);
+                }
+                break;
+            case FilesystemBitmapRangeModification:
+                for (uint64_t i = record.action_param2; record.action_param1 && i < record.action_param2 + record.action_param3 && i < blocks; i++) {
+                    claimed.push_back(i);
+                }
+                break;
+            case GlobalTransaction_CreateRedundancy:
+                if (record.action_param1 < blocks && record.action_param2 < blocks) {
+                    copies.emplace_back(record.action_param1, record.action_param2);
+                }
+                break;
+            case GlobalTransaction_DeallocateBlock:
+                if (record.action_param1 < blocks) {
+                    released.push_back(record.action_param1);
+                }
+                break;
+            case GlobalTransaction_OverwriteInPlace:
+                if (record.action_param1 < blocks && record.action_param2 < blocks) {
+                    overwrites.push_back({ record.action_param1, record.action_param2, record.action_param3 });
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // claimed blocks are typed by their owner, nothing can reach them before the transaction links them
+    auto retire_claimed = [&](const tsl::hopscotch_set < uint64_t > & linked)->bool
+    {
+        bool any_linked = false;
+        for (const uint64_t index : claimed)
+        {
+            if (linked.contains(index)) {
+                any_linked = true;
+            } else if (bitmap_->get_bit(index) && block_attribute_->get<block_type>(index) != COW_REDUNDANCY_BLOCK) {
+                retire(index);
+            }
+        }
+
+        return any_linked;
+    };
+
+    switch (plain.action_param0)
+    {
+        // a claimed block is a CoW redundancy until its owner types it, a released one already is one,
+        // so whatever these left behind is queued by the reclaimer on mount and goes back to the bitmap
+        case FilesystemBitmapModification:
+        case FilesystemBitmapRangeModification:
+        case GlobalTransaction_ReclaimRedundancy:
+            return -1;
+
+        // the owner may have typed the block already, but nobody links it
+        case GlobalTransaction_AllocateBlock:
+        case GlobalTransaction_AllocateRange:
+            retire_claimed({ });
+            return -1;
+
+        // the before-image was being made, the block itself is untouched
+        case GlobalTransaction_OverwriteInPlace:
+        {
+            const uint64_t copy = plain.action_param2;
+            if (copy < blocks && live(copy)) {
+                retire(copy);
+            }
+            return -1;
+        }
+
+        // the copy is only linked once the transaction closed, nobody can reach it
+        case GlobalTransaction_CreateRedundancy:
+        {
+            const uint64_t copy = plain.action_param2;
+            if (copy < blocks && bitmap_->get_bit(copy)
+                && block_attribute_->get<block_type>(copy) != COW_REDUNDANCY_BLOCK)
+            {
+                retire(copy);
+            }
+            return -1;
+        }
+
+        // an exclusive block was being retired, finish it. A shared one only loses a reference,
+        // whether that happened can't be told, so it is kept
+        case GlobalTransaction_DeallocateBlock:
+        {
+            const uint64_t index = plain.action_param1;
+            if (index >= blocks || !exclusive(index)) {
+                return 0;
+            }
+
+            if (block_attribute_->get<block_type>(index) != COW_REDUNDANCY_BLOCK) {
+                retire(index);
+            }
+            return 1;
+        }
+
+        // the inode's pointer tree on disk tells which blocks the write or resize got to link.
+        // everything else it claimed is dropped, and every original is left as the tree wants it
+        case GlobalTransaction_Major_WriteInode:
+        case GlobalTransaction_Major_ResizeInode:
+        {
+            const uint64_t inode = plain.action_param1;
+            if (inode >= blocks || !bitmap_->get_bit(inode) || block_attribute_->get<block_type>(inode) != INDEX_NODE_BLOCK) {
+                return 0; // the inode itself moved or went away, left for fsck
+            }
+
+            // blocks overwritten in place get their before-image back, if the image is complete. An incomplete
+            // one means the overwrite never started. Pointer blocks are restored before the tree is read
+            bool restored = false;
+            for (const auto & [index, copy, crc] : overwrites)
+            {
+                if (!live(copy) || block_crc(copy) != crc || block_crc(index) == crc) {
+                    continue;
+                }
+
+                restored = true;
+                if (apply)
+                {
+                    const auto image = parent_fs_governor_->lock_shared(copy + parent_fs_governor_->static_info_.data_table_start);
+                    const auto target = parent_fs_governor_->lock(index + parent_fs_governor_->static_info_.data_table_start);
+                    std::memcpy(target.data(), image.data(), target.size());
+                    block_attribute_->set<block_checksum>(index, block_attribute_->get<block_checksum>(copy));
+                }
+            }
+
+            const auto linked = linked_blocks(inode);
+            const bool forward = retire_claimed(linked);
+            bool ambiguous = false;
+
+            // an original still linked was retired too early, one its copy replaced wasn't retired yet.
+            // a shared original only lost a reference, whether it did can't be told
+            auto settle = [&](const uint64_t original, const bool keep)
+            {
+                if (!exclusive(original) || !bitmap_->get_bit(original))
+                {
+                    ambiguous = true;
+                    return;
+                }
+
+                const bool retired = block_attribute_->get<block_type>(original) == COW_REDUNDANCY_BLOCK;
+                if (keep && retired) {
+                    restore(original);
+                } else if (!keep && !retired) {
+                    retire(original);
+                }
+            };
+
+            for (const auto & [original, copy] : copies)
+            {
+                if (linked.contains(original) != linked.contains(copy)) {
+                    settle(original, linked.contains(original));
+                }
+            }
+
+            for (const uint64_t index : released)
+            {
+                if (linked.contains(index)) {
+                    settle(index, true);
                 }
             }
 
-            /// remove oldest ones
-            std::ranges::for_each(scanned_cow_blocks, [&](const std::pair<uint64_t, uint64_t> & block)
-            {
-                if (block.second >= oldest / 2) {
-                    bitmap_->set_bit(block.first, false);
-                }
-            });
+            if (ambiguous) {
+                return 0;
+            }
+
+            if (restored) {
+                return -1;
+            }
+
+            // nothing claimed and nothing to restore means the write went in place without a before-image,
+            // into blocks of the transaction group. how far it got can't be told, that is for fsck
+            if (claimed.empty()) {
+                return 0;
+            }
+
+            return forward ? 1 : -1;
+        }
+
+        // inode CoW, dentries and snapshots are not journaled block by block, these are left for fsck
+        default:
+            return 0;
+    }
+}
+
+void cfs::cfs_block_map_cache_t::evict_unblocked()
+{
+    // always keep the most recent one, even if it alone exceeds the capacity
+    while (cached_pointers_ > capacity_ && lru_.size() > 1)
+    {
+        const auto victim = maps_.find(lru_.back());
+        cached_pointers_ -= victim->second.accounted_pointers;
+        maps_.erase(victim);
+        lru_.pop_back();
+    }
+}
+
+cfs::cfs_block_map_cache_t::block_map_ptr_t cfs::cfs_block_map_cache_t::get(const uint64_t inode)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = maps_.find(inode);
+    if (it == maps_.end()) {
+        return nullptr;
+    }
+
+    lru_.splice(lru_.begin(), lru_, it->second.lru_position); // touch
+    return it->second.map;
+}
+
+void cfs::cfs_block_map_cache_t::put(const uint64_t inode, const block_map_ptr_t & map)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (const auto it = maps_.find(inode); it != maps_.end())
+    {
+        cached_pointers_ -= it->second.accounted_pointers;
+        lru_.erase(it->second.lru_position);
+        maps_.erase(it);
+    }
+
+    map->generation = ++next_generation_;
+    lru_.push_front(inode);
+    maps_.emplace(inode, cache_entry_t{
+        .map = map, .lru_position = lru_.begin(), .accounted_pointers = map->pointers(), .generation = map->generation });
+    cached_pointers_ += map->pointers();
+    evict_unblocked();
+}
+
+bool cfs::cfs_block_map_cache_t::current(const uint64_t inode, const block_map_t & map)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = maps_.find(inode);
+    return it != maps_.end() && it->second.map.get() == &map && it->second.generation == map.generation;
+}
+
+void cfs::cfs_block_map_cache_t::changed(const uint64_t inode)
+{
+    invalidate(inode);
+}
+
+void cfs::cfs_block_map_cache_t::invalidate(const uint64_t inode)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (const auto it = maps_.find(inode); it != maps_.end())
+    {
+        cached_pointers_ -= it->second.accounted_pointers;
+        lru_.erase(it->second.lru_position);
+        maps_.erase(it);
+    }
+}
+
+void cfs::cfs_block_map_cache_t::relocate(const uint64_t from, const uint64_t to)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = maps_.find(from);
+    if (it == maps_.end()) {
+        return;
+    }
+
+    const auto entry = it->second;
+    maps_.erase(it);
+    if (const auto old = maps_.find(to); old != maps_.end())
+    {
+        cached_pointers_ -= old->second.accounted_pointers;
+        lru_.erase(old->second.lru_position);
+        maps_.erase(old);
+    }
+
+    *entry.lru_position = to;
+    lru_.splice(lru_.begin(), lru_, entry.lru_position);
+    maps_.emplace(to, entry);
+}
+
+void cfs::cfs_transaction_group_t::commit_unblocked()
+{
+    if (dirty_blocks_.empty()) {
+        opened_at_ = std::chrono::steady_clock::now();
+        return; // nothing happened in this group
+    }
+
+    journal_->push_action(TransactionGroupCommit, transaction_group_id_, dirty_blocks_.size());
+    dirty_blocks_.clear();
+    transaction_group_id_++;
+    opened_at_ = std::chrono::steady_clock::now();
+}
+
+void cfs::cfs_transaction_group_t::commit_if_needed_unblocked()
+{
+    if (dirty_blocks_.size() >= max_dirty_blocks_
+        || std::chrono::steady_clock::now() - opened_at_ >= std::chrono::seconds(timeout_))
+    {
+        commit_unblocked();
+    }
+}
+
+void cfs::cfs_transaction_group_t::work()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (enabled_)
+    {
+        // sleep until the open group times out, set_mode() wakes us up early
+        condition_.wait_until(lock, opened_at_ + std::chrono::seconds(timeout_));
+        if (enabled_) {
+            commit_if_needed_unblocked();
+        }
+    }
+}
+
+cfs::cfs_transaction_group_t::~cfs_transaction_group_t()
+{
+    std::lock_guard<std::mutex> timer_lock(timer_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        enabled_ = false;
+    }
+
+    condition_.notify_all();
+    if (timer_.joinable()) {
+        timer_.join();
+    }
+}
+
+void cfs::cfs_transaction_group_t::set_mode(const uint64_t timeout, const uint64_t max_dirty_blocks)
+{
+    std::lock_guard<std::mutex> timer_lock(timer_mutex_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commit_unblocked();
+        timeout_ = timeout;
+        max_dirty_blocks_ = max_dirty_blocks;
+        enabled_ = timeout != 0;
+    }
+
+    condition_.notify_all(); // a running timer picks the new timeout up, or leaves
+    if (enabled_ && !timer_.joinable()) {
+        timer_ = std::thread(&cfs_transaction_group_t::work, this);
+    } else if (!enabled_ && timer_.joinable()) {
+        timer_.join();
+    }
+}
+
+void cfs::cfs_transaction_group_t::adopt(const uint64_t index)
+{
+    if (!enabled_) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    commit_if_needed_unblocked();
+    dirty_blocks_.insert(index);
+}
+
+bool cfs::cfs_transaction_group_t::owns(const uint64_t index)
+{
+    if (!enabled_) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    commit_if_needed_unblocked();
+    return dirty_blocks_.contains(index);
+}
+
+void cfs::cfs_transaction_group_t::commit()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    commit_unblocked();
+}
+
+cfs::cfs_redundancy_reclaimer_t::cfs_redundancy_reclaimer_t(
+    cfs_bitmap_block_mirroring_t *bitmap,
+    cfs_block_attribute_access_t *block_attribute,
+    cfs_journaling_t *journal,
+    const uint64_t blocks)
+: bitmap_(bitmap), block_attribute_(block_attribute), journal_(journal), blocks_(blocks)
+{
+    set_watermark(default_watermark_percent);
+
+    // garbage left by the last mount, one pass over the bitmap a word at a time
+    const auto map = bitmap_->dump();
+    for (uint64_t word_index = 0; word_index < map.size() / sizeof(uint64_t); word_index++)
+    {
+        uint64_t word;
+        std::memcpy(&word, map.data() + word_index * sizeof(uint64_t), sizeof(word));
+        for (; word != 0; word &= word - 1)
+        {
+            if (const uint64_t index = word_index * 64 + std::countr_zero(word); index < blocks_ && reclaimable(index)) {
+                push(index);
+            }
+        }
+    }
+}
+
+bool cfs::cfs_redundancy_reclaimer_t::reclaimable(const uint64_t index)
+{
+    const auto attr = block_attribute_->get(index);
+    return bitmap_->get_bit(index) && (attr.block_type == COW_REDUNDANCY_BLOCK || attr.index_node_referencing_number == 0);
+}
+
+void cfs::cfs_redundancy_reclaimer_t::push(const uint64_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queued_.insert(index).second) {
+        queue_.push_back(index);
+    }
+}
+
+uint64_t cfs::cfs_redundancy_reclaimer_t::reclaim(const uint64_t count)
+{
+    bool success = false;
+    g_transaction(journal_, success, GlobalTransaction_ReclaimRedundancy, count);
+
+    uint64_t reclaimed = 0;
+    while (reclaimed < count)
+    {
+        uint64_t index;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.empty()) {
+                break;
+            }
+
+            index = queue_.front();
+            queue_.pop_front();
+            queued_.erase(index);
+        }
+
+        // a snapshot can hand out references to a block again, skip it then. re-check and clear as one step,
+        // under the gate such a snapshot holds
+        std::lock_guard<std::mutex> gate(gate_mutex_);
+        if (reclaimable(index)) {
+            bitmap_->set_bit(index, false);
+            reclaimed++;
+        }
+    }
+
+    success = true;
+    return reclaimed;
+}
+
+void cfs::cfs_redundancy_reclaimer_t::notify()
+{
+    if (running_ && bitmap_->free_bits() < watermark_) {
+        condition_.notify_one();
+    }
+}
+
+void cfs::cfs_redundancy_reclaimer_t::work()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_)
+    {
+        // allocations wake us up when they go below the watermark, the timeout catches everything else
+        condition_.wait_for(lock, std::chrono::seconds(1), [this] {
+            return !running_ || (!queue_.empty() && bitmap_->free_bits() < watermark_);
+        });
+
+        if (running_ && !queue_.empty() && bitmap_->free_bits() < watermark_)
+        {
+            lock.unlock();
+            reclaim(batch);
+            lock.lock();
+        }
+    }
+}
+
+void cfs::cfs_redundancy_reclaimer_t::start()
+{
+    if (running_.exchange(true)) {
+        return;
+    }
+
+    worker_ = std::thread(&cfs_redundancy_reclaimer_t::work, this);
+}
+
+void cfs::cfs_redundancy_reclaimer_t::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_.exchange(false)) {
+            return;
+        }
+    }
+
+    condition_.notify_all();
+    worker_.join();
+}
+
+uint64_t cfs::cfs_redundancy_reclaimer_t::queued()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+cfs::cfs_block_manager_t::cfs_block_manager_t(
+    cfs_bitmap_block_mirroring_t *bitmap,
+    filesystem::cfs_header_block_t *header,
+    cfs_block_attribute_access_t *block_attribute,
+    cfs_journaling_t *journal)
+: bitmap_(bitmap), header_(header), block_attribute_(block_attribute), journal_(journal), transaction_group_(journal),
+    reclaimer_(bitmap, block_attribute, journal, header->get_static_info().data_table_end - header->get_static_info().data_table_start),
+    map_size_(header->get_static_info().data_table_end - header->get_static_info().data_table_start),
+    metadata_area_end_(map_size_ / metadata_area_ratio)
+{
+    block_attribute_->set_reclaimable_hook([this](const uint64_t index) { reclaimer_.push(index); });
+
+    const auto group_size = header_->get_static_info().block_size * 8;
+    const auto storage_groups = (map_size_ - metadata_area_end_ + group_size - 1) / group_size;
+    for (uint64_t slot = 0; slot < allocation_slots; slot++) {
+        cursors_[slot].next = metadata_area_end_ + slot % storage_groups * group_size;
+    }
+}
+
+std::atomic<uint64_t> & cfs::cfs_block_manager_t::cursor()
+{
+    // threads take slots round-robin, so the first allocation_slots threads never share one
+    static std::atomic<uint64_t> next_slot = 0;
+    thread_local const uint64_t slot = next_slot++ % allocation_slots;
+    return cursors_[slot].next;
+}
+
+void cfs::cfs_block_manager_t::prepare_claimed_block(const uint64_t index)
+{
+    block_map_cache_.invalidate(index); // whatever was cached for this block is gone now
+    transaction_group_.adopt(index);
+    block_attribute_->clear(index, {
+        .block_status = BLOCK_AVAILABLE_TO_MODIFY_0x00,
+        .block_type = COW_REDUNDANCY_BLOCK,
+        .block_type_cow = 0,
+        .allocation_oom_scan_per_refresh_count = 0,
+        .index_node_referencing_number = 1,
+        .block_checksum = 0
+    });
+}
+
+uint64_t cfs::cfs_block_manager_t::allocate(const uint64_t goal)
+{
+    const auto map_size = map_size_;
+    const bool goal_directed = goal < map_size;
+    auto & cursor_ = cursor();
+    bool operation_success = true;
+    g_transaction(journal_, operation_success, GlobalTransaction_AllocateBlock);
+
+    auto refresh_allocate = [&](bool & success, const uint64_t start, const uint64_t end)
+    {
+        for (uint64_t i = bitmap_->find_first_zero(start, end); i < end; i = bitmap_->find_first_zero(i + 1, end))
+        {
+            // another thread can claim the bit between the scan and here, keep scanning if so
+            if (bitmap_->test_and_set_bit(i)) {
+                /// get one
+                /// record last allocated position, goal directed allocations leave the cursor alone
+                if (!goal_directed) {
+                    cursor_ = i + 1;
+                }
+                // allocate
+                journal_claim(i, 1);
+                prepare_claimed_block(i);
+                success = true;
+                return i;
+            }
+        }
+
+        success = false;
+        return 0ul;
+    };
+
+    auto fully_allocate_by_running_through = [&]->uint64_t
+    {
+        bool success;
+        if (const uint64_t ret = refresh_allocate(success, 0, map_size); success) {
+            return ret; // found
+        }
+
+        // not found, the summary reported no cleared page so the scan above was a single lookup.
+        // give the oldest redundancies back right here, the queue knows them so nothing is scanned
+        while (reclaimer_.reclaim(cfs_redundancy_reclaimer_t::batch) != 0)
+        {
+            if (const uint64_t ret = refresh_allocate(success, 0, map_size); success) {
+                return ret; // found one
+            }
+        }
+
+        journal_->push_action(FilesystemBlockExhausted);
+        // still, no free blocks, report filesystem as fully occupied
+        operation_success = false;
+        throw error::no_more_free_spaces();
+    };
+
+    uint64_t ret;
+    bool success = false;
+    if (const uint64_t start = goal_directed ? goal : cursor_.load(); start < map_size) {
+        ret = refresh_allocate(success, start, map_size);
+    }
+
+    if (!success) {
+        ret = fully_allocate_by_running_through();
+    }
+
+    reclaimer_.notify();
+    return ret;
+}
+
+cfs::cfs_block_manager_t::extents_t cfs::cfs_block_manager_t::allocate_range(const uint64_t count, const uint8_t type, const uint64_t goal)
+{
+    const auto map_size = map_size_;
+    bool operation_success = false;
+    g_transaction(journal_, operation_success, GlobalTransaction_AllocateRange, count, goal);
+
+    extents_t extents;
+    uint64_t remaining = count;
+    auto & cursor_ = cursor();
+    const uint64_t first = goal < map_size ? goal : cursor_ % map_size;
+    uint64_t cursor = first;
+    bool wrapped = first == 0;
+    while (remaining != 0)
+    {
+        const auto index = bitmap_->find_first_zero(cursor, map_size);
+        if (index == map_size)
+        {
+            if (wrapped) {
+                break; // nothing left in a plain scan, allocate() below knows how to reclaim
+            }
+
+            cursor = 0;
+            wrapped = true;
+            continue;
+        }
+
+        // another thread can claim the bit between the scan and here, claim_range() returns 0 then
+        const auto claimed = bitmap_->claim_range(index, remaining);
+        if (claimed != 0) {
+            journal_claim(index, claimed);
+        }
+        for (uint64_t i = index; i < index + claimed; i++) {
+            prepare_claimed_block(i);
+            block_attribute_->set<block_type>(i, type);
+        }
 
-            // run the allocator again
-            if (const auto ret_again = refresh_allocate(success, 0, map_size); !success) {
-                journal_->push_action(FilesystemBlockExhausted);
-                // still, no free blocks, report filesystem as fully occupied
-                operation_success = false;
-                throw error::no_more_free_spaces();
+        if (claimed != 0)
+        {
+            // claims stop at bitmap page ends, glue the pieces of one run back together
+            if (!extents.empty() && extents.back().first + extents.back().second == index) {
+                extents.back().second += claimed;
             } else {
-                return ret_again; // found one
+                extents.emplace_back(index, claimed);
+            }
+            if (goal >= map_size) {
+                cursor_ = std::min(index + claimed + stream_window, map_size);
             }
         }
-        else {
-            return ret; // found
-        }
-    };
+        remaining -= claimed;
+        cursor = index + std::max<uint64_t>(claimed, 1);
+    }
 
-    if (header_->get_info<last_allocated_block>() + 1 < map_size)
+    // image is (nearly) full, fall back to one block at a time which runs redundancy reclaim.
+    // blocks claimed above already carry their type, so the reclaim can't take them back
+    for (; remaining != 0; remaining--)
     {
-        bool success;
-        if (const auto ret = refresh_allocate(
-            success,
-            header_->get_info<last_allocated_block>() + 1,
-            map_size); success)
-        {
-            return ret;
+        const auto index = allocate(goal);
+        block_attribute_->set<block_type>(index, type);
+        if (!extents.empty() && extents.back().first + extents.back().second == index) {
+            extents.back().second++;
+        } else {
+            extents.emplace_back(index, 1);
         }
     }
 
-    return fully_allocate_by_running_through();
+    reclaimer_.notify();
+    operation_success = true;
+    return extents;
+}
+
+void cfs::cfs_block_manager_t::journal_claim(const uint64_t start, const uint64_t count)
+{
+    bool success = false;
+    g_transaction(journal_, success, FilesystemBitmapRangeModification, true, start, count);
+    success = true;
 }
 
 void cfs::cfs_block_manager_t::deallocate(const uint64_t index)
@@ -417,6 +1629,23 @@ cfs::cfs_inode_service_t::page_locker_t::~page_locker_t()
     }
 }
 
+cfs::cfs_inode_service_t::continuous_page_locker_t::continuous_page_locker_t(const uint64_t start, const uint64_t count,
+    filesystem *fs, cfs_inode_service_t *parent)
+    : lock_(fs->lock_continuous(start + fs->static_info_.data_table_start, count)), parent_(parent), start_(start)
+{
+}
+
+cfs::cfs_inode_service_t::continuous_page_locker_t::~continuous_page_locker_t()
+{
+    const auto block_size = parent_->block_size_;
+    for (uint64_t offset = 0; offset < lock_.size(); offset += block_size)
+    {
+        parent_->block_attribute_->set<block_checksum>(start_ + offset / block_size,
+            utils::arithmetic::hash5(reinterpret_cast<uint8_t *>(lock_.data() + offset), block_size)
+        );
+    }
+}
+
 cfs::cfs_inode_service_t::page_locker_t cfs::cfs_inode_service_t::lock_page(const uint64_t index, const bool linker)
 {
     cfs_assert_simple(index != block_index_
@@ -427,6 +1656,42 @@ cfs::cfs_inode_service_t::page_locker_t cfs::cfs_inode_service_t::lock_page(cons
     return {index, parent_fs_governor_, this};
 }
 
+cfs::filesystem::shared_guard cfs::cfs_inode_service_t::lock_page_shared(const uint64_t index, const bool linker)
+{
+    cfs_assert_simple(index != block_index_
+        && index < (parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start));
+    if (!linker && block_attribute_->get<block_type>(index) == POINTER_BLOCK) {
+        throw cfs::error::assertion_failed("Attempt to read pointer without stating as linker");
+    }
+    return parent_fs_governor_->lock_shared(index + parent_fs_governor_->static_info_.data_table_start);
+}
+
+cfs::cfs_inode_service_t::continuous_page_locker_t cfs::cfs_inode_service_t::lock_pages_continuous(const uint64_t start, const uint64_t count)
+{
+    const auto data_blocks = parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start;
+    cfs_assert_simple(count <= data_blocks && start <= data_blocks - count
+        && (block_index_ < start || block_index_ >= start + count));
+    for (uint64_t i = start; i < start + count; i++) {
+        if (block_attribute_->get<block_type>(i) == POINTER_BLOCK) {
+            throw cfs::error::assertion_failed("Attempt to write pointer without stating as linker");
+        }
+    }
+    return {start, count, parent_fs_governor_, this};
+}
+
+cfs::filesystem::guard_continuous cfs::cfs_inode_service_t::lock_pages_continuous_shared(const uint64_t start, const uint64_t count)
+{
+    const auto data_blocks = parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start;
+    cfs_assert_simple(count <= data_blocks && start <= data_blocks - count
+        && (block_index_ < start || block_index_ >= start + count));
+    for (uint64_t i = start; i < start + count; i++) {
+        if (block_attribute_->get<block_type>(i) == POINTER_BLOCK) {
+            throw cfs::error::assertion_failed("Attempt to read pointer without stating as linker");
+        }
+    }
+    return parent_fs_governor_->lock_continuous(start + parent_fs_governor_->static_info_.data_table_start, count, true);
+}
+
 uint64_t cfs::cfs_inode_service_t::copy_on_write(const uint64_t index, const bool linker)
 {
     if (parent_fs_governor_->global_control_flags.load().no_pointer_and_storage_cow) {
@@ -434,9 +1699,20 @@ uint64_t cfs::cfs_inode_service_t::copy_on_write(const uint64_t index, const boo
     }
 
     cfs_assert_simple(index != block_index_); // can't CoW on my own. this should be done by dentry
-    bool success = false;
-    const auto new_block = block_manager_->allocate();
+    if (modifiable_in_place(index)) {
+        keep_before_image(index, linker);
+        return index; // nobody else can see this block
+    }
+
+    // pointer blocks (linker) stay close to their inode
+    const auto new_block = linker ? block_manager_->allocate(block_manager_->metadata_goal(block_index_)) : block_manager_->allocate();
     block_attribute_->set<block_type>(new_block, STORAGE_BLOCK);
+    return copy_to_redundancy(index, new_block, linker);
+}
+
+uint64_t cfs::cfs_inode_service_t::copy_to_redundancy(const uint64_t index, const uint64_t new_block, const bool linker)
+{
+    bool success = false;
     g_transaction(journal_, success, GlobalTransaction_CreateRedundancy, index, new_block);
     const auto new_ = lock_page(new_block, linker);
     const auto old_ = lock_page(index, linker);
@@ -447,7 +1723,341 @@ uint64_t cfs::cfs_inode_service_t::copy_on_write(const uint64_t index, const boo
     return new_block;
 }
 
+std::vector<uint64_t> cfs::cfs_inode_service_t::allocate_blocks(const uint64_t count, const uint8_t type, const uint64_t goal)
+{
+    std::vector<uint64_t> blocks;
+    if (count == 0) {
+        return blocks;
+    }
+
+    blocks.reserve(count);
+    for (const auto & [start, length] : block_manager_->allocate_range(count, type, goal)) {
+        for (uint64_t i = start; i < start + length; i++) {
+            blocks.push_back(i);
+        }
+    }
+
+    return blocks;
+}
+
+bool cfs::cfs_inode_service_t::modifiable_in_place(const uint64_t index, const bool data_block)
+{
+    if (block_manager_->transaction_group().owns(index)) {
+        return true;
+    }
+
+    // NOCOW covers file data only, pointer blocks and the inode itself are still CoW'd
+    if (!parent_fs_governor_->global_control_flags.load().overwrite_exclusive_blocks
+        && !(data_block && (cfs_inode_attribute->st_flags & inode_flag_nocow)))
+    {
+        return false;
+    }
+
+    const auto attr = block_attribute_->get(index);
+    return attr.block_status == BLOCK_AVAILABLE_TO_MODIFY_0x00 && attr.index_node_referencing_number <= 1;
+}
+
+void cfs::cfs_inode_service_t::keep_before_image(const uint64_t index, const bool linker)
+{
+    if (block_manager_->transaction_group().owns(index) || before_images_.contains(index)) {
+        return;
+    }
+
+    const auto copy = block_manager_->allocate(block_manager_->storage_goal(index));
+    block_attribute_->set<block_type>(copy, STORAGE_BLOCK);
+    const auto new_ = lock_page(copy, linker);
+    const auto old_ = lock_page(index, linker);
+    const auto crc = utils::arithmetic::hash64(reinterpret_cast<const uint8_t *>(old_->data()), block_size_);
+
+    // replay copies the before-image back only if its CRC matches, i.e., the copy below finished
+    bool success = false;
+    g_transaction(journal_, success, GlobalTransaction_OverwriteInPlace, index, copy, crc);
+    std::memcpy(new_->data(), old_->data(), block_size_);
+    before_images_.emplace(index, copy);
+    success = true;
+}
+
+void cfs::cfs_inode_service_t::release_before_images()
+{
+    for (const auto copy : before_images_ | std::views::values) {
+        retire_block(copy);
+    }
+    before_images_.clear();
+}
+
 cfs::cfs_inode_service_t::linearized_block_t cfs::cfs_inode_service_t::linearize_all_blocks()
+{
+    const auto map = block_map();
+    return {
+        .level1_pointers = map->level1_pointers,
+        .level2_pointers = map->level2_pointers,
+        .level3_pointers = map->level3_pointers
+    };
+}
+
+cfs::cfs_block_map_cache_t::block_map_ptr_t cfs::cfs_inode_service_t::cached_block_map()
+{
+    // every change to the pointer tree either puts the map again or drops it, so a map still cached at the
+    // generation it was handed out with follows the tree. size is checked as well, it changes without the tree
+    auto map_matches_inode = [&](const cfs_block_map_cache_t::block_map_t & map)->bool {
+        return map.st_size == static_cast<uint64_t>(this->cfs_inode_attribute->st_size);
+    };
+
+    if (block_map_ != nullptr && map_matches_inode(*block_map_)
+        && block_manager_->block_map_cache().current(block_index_, *block_map_))
+    {
+        return block_map_;
+    }
+
+    block_map_ = block_manager_->block_map_cache().get(block_index_);
+    if (block_map_ != nullptr && map_matches_inode(*block_map_)) {
+        return block_map_;
+    }
+
+    block_map_.reset();
+    return nullptr;
+}
+
+cfs::cfs_block_map_cache_t::block_map_ptr_t cfs::cfs_inode_service_t::block_map()
+{
+    if (const auto map = cached_block_map(); map != nullptr) {
+        return map;
+    }
+
+    auto [level1, level2, level3] = linearize_all_blocks_from_disk();
+    block_map_ = std::make_shared<cfs_block_map_cache_t::block_map_t>();
+    block_map_->st_size = this->cfs_inode_attribute->st_size;
+    block_map_->level1_pointers = std::move(level1);
+    block_map_->level2_pointers = std::move(level2);
+    block_map_->level3_pointers = std::move(level3);
+    block_manager_->block_map_cache().put(block_index_, block_map_);
+    return block_map_;
+}
+
+void cfs::cfs_inode_service_t::update_block_map(const allocation_map_t & descriptor)
+{
+    auto copy_over = [](const std::vector<std::pair<uint64_t, bool>> & from, std::vector<uint64_t> & to)
+    {
+        to.clear();
+        to.reserve(from.size());
+        std::ranges::for_each(from, [&](const std::pair<uint64_t, bool> & ptr) { to.push_back(ptr.first); });
+    };
+
+    auto new_map = std::make_shared<cfs_block_map_cache_t::block_map_t>();
+    new_map->st_size = this->cfs_inode_attribute->st_size;
+    copy_over(descriptor.level1_pointers, new_map->level1_pointers);
+    copy_over(descriptor.level2_pointers, new_map->level2_pointers);
+    copy_over(descriptor.level3_pointers, new_map->level3_pointers);
+    block_map_ = new_map;
+    block_manager_->block_map_cache().put(block_index_, block_map_);
+}
+
+uint64_t cfs::cfs_inode_service_t::resolve_block(const uint64_t logical_block)
+{
+    const auto descriptor = size_to_linearized_block_descriptor(this->cfs_inode_attribute->st_size);
+    cfs_assert_simple(logical_block < descriptor.level3_pointers);
+
+    if (const auto map = cached_block_map(); map != nullptr) {
+        return map->level3_pointers[logical_block];
+    }
+
+    // level 1 (in inode) -> level 2 pointer -> level 3 pointer
+    const uint64_t pointers_per_block = block_size_ / sizeof(uint64_t);
+    const uint64_t level2_offset = logical_block / pointers_per_block; // which level 2 pointer
+    const uint64_t level1_offset = level2_offset / pointers_per_block; // which level 1 pointer
+
+    auto read_pointer = [&](const uint64_t pointer_block, const uint64_t offset)->uint64_t
+    {
+        const auto lock = lock_page_shared(pointer_block, true);
+        uint64_t pointer = 0;
+        std::memcpy(&pointer, lock.data() + offset * sizeof(uint64_t), sizeof(uint64_t));
+        return pointer;
+    };
+
+    const uint64_t level2_block = read_pointer(this->cfs_level_1_indexes[level1_offset], level2_offset % pointers_per_block);
+    return read_pointer(level2_block, logical_block % pointers_per_block);
+}
+
+void cfs::cfs_inode_service_t::retire_block(const uint64_t index)
+{
+    if (block_attribute_->get<block_status>(index) == BLOCK_AVAILABLE_TO_MODIFY_0x00) {
+        block_attribute_->move<block_type, block_type_cow>(index);
+        block_attribute_->set<block_type>(index, COW_REDUNDANCY_BLOCK); // mark the old one as freeable CoW redundancy
+    } else {
+        block_attribute_->dec<index_node_referencing_number>(index);
+    }
+}
+
+uint64_t cfs::cfs_inode_service_t::relink_pointer_block(
+    const uint64_t index,
+    const std::vector<std::pair<uint64_t, uint64_t>> & patches)
+{
+    const auto new_block = copy_on_write(index, true);
+    if (new_block != index) {
+        block_attribute_->set<block_type>(new_block, POINTER_BLOCK);
+    }
+
+    {
+        const auto lock = lock_page(new_block, true);
+        std::ranges::for_each(patches, [&](const std::pair<uint64_t, uint64_t> & patch) {
+            std::memcpy(lock->data() + patch.first * sizeof(uint64_t), &patch.second, sizeof(uint64_t));
+        });
+    }
+
+    if (new_block != index) {
+        retire_block(index);
+    }
+
+    return new_block;
+}
+
+cfs::cfs_inode_service_t::pointer_patches_t cfs::cfs_inode_service_t::patch_pointer_level(
+    const pointer_patches_t & patches,
+    const uint64_t existing_blocks,
+    const std::function<uint64_t(uint64_t)> & pointer_block)
+{
+    const uint64_t pointers_per_block = block_size_ / sizeof(uint64_t);
+    pointer_patches_t upper_patches;
+
+    auto patch_one_block = [&](const uint64_t block_offset, const pointer_patches_t & in_block_patches)
+    {
+        if (block_offset < existing_blocks)
+        {
+            const auto old_block = pointer_block(block_offset);
+            if (const auto new_block = relink_pointer_block(old_block, in_block_patches); new_block != old_block) {
+                upper_patches.emplace_back(block_offset, new_block);
+            }
+        }
+        else
+        {
+            const auto new_block = block_manager_->allocate(block_manager_->metadata_goal(block_index_));
+            block_attribute_->set<block_type>(new_block, POINTER_BLOCK);
+            {
+                const auto lock = lock_page(new_block, true);
+                std::memset(lock->data(), 0, lock->size());
+                std::ranges::for_each(in_block_patches, [&](const std::pair<uint64_t, uint64_t> & patch) {
+                    std::memcpy(lock->data() + patch.first * sizeof(uint64_t), &patch.second, sizeof(uint64_t));
+                });
+            }
+            upper_patches.emplace_back(block_offset, new_block);
+        }
+    };
+
+    // patches are sorted, so pointers in the same block are adjacent
+    pointer_patches_t in_block_patches;
+    uint64_t current_block = UINT64_MAX;
+    for (const auto & [offset, pointer] : patches)
+    {
+        if (offset / pointers_per_block != current_block)
+        {
+            if (!in_block_patches.empty()) {
+                patch_one_block(current_block, in_block_patches);
+            }
+            in_block_patches.clear();
+            current_block = offset / pointers_per_block;
+        }
+
+        in_block_patches.emplace_back(offset % pointers_per_block, pointer);
+    }
+
+    if (!in_block_patches.empty()) {
+        patch_one_block(current_block, in_block_patches);
+    }
+
+    return upper_patches;
+}
+
+void cfs::cfs_inode_service_t::patch_pointer_tree(
+    const pointer_patches_t & level3_patches,
+    const linearized_block_descriptor_t & descriptor)
+{
+    const uint64_t pointers_per_block = block_size_ / sizeof(uint64_t);
+    const auto map = cached_block_map(); // fetch before inode changes, or it won't match anymore
+
+    auto level2_block = [&](const uint64_t level2_offset)->uint64_t
+    {
+        if (map != nullptr) {
+            return map->level2_pointers[level2_offset];
+        }
+
+        const auto lock = lock_page_shared(this->cfs_level_1_indexes[level2_offset / pointers_per_block], true);
+        uint64_t pointer = 0;
+        std::memcpy(&pointer, lock.data() + (level2_offset % pointers_per_block) * sizeof(uint64_t), sizeof(uint64_t));
+        return pointer;
+    };
+
+    auto level1_block = [&](const uint64_t level1_offset)->uint64_t {
+        return this->cfs_level_1_indexes[level1_offset];
+    };
+
+    const auto level2_patches = patch_pointer_level(level3_patches, descriptor.level2_pointers, level2_block);
+    const auto level1_patches = patch_pointer_level(level2_patches, descriptor.level1_pointers, level1_block);
+    std::ranges::for_each(level1_patches, [&](const std::pair<uint64_t, uint64_t> & patch) {
+        this->cfs_level_1_indexes[patch.first] = patch.second;
+    });
+
+    if (map != nullptr)
+    {
+        auto apply = [](std::vector<uint64_t> & level, const pointer_patches_t & level_patches)
+        {
+            std::ranges::for_each(level_patches, [&](const std::pair<uint64_t, uint64_t> & patch)
+            {
+                if (patch.first < level.size()) {
+                    level[patch.first] = patch.second;
+                } else {
+                    cfs_assert_simple(patch.first == level.size());
+                    level.push_back(patch.second);
+                }
+            });
+        };
+
+        apply(map->level3_pointers, level3_patches);
+        apply(map->level2_pointers, level2_patches);
+        apply(map->level1_pointers, level1_patches);
+        block_manager_->block_map_cache().put(block_index_, map);
+    }
+    else
+    {
+        block_manager_->block_map_cache().changed(block_index_);
+    }
+}
+
+void cfs::cfs_inode_service_t::relink_storage_blocks(const std::map<uint64_t, uint64_t> & relink_map)
+{
+    const pointer_patches_t level3_patches(relink_map.begin(), relink_map.end());
+    patch_pointer_tree(level3_patches, size_to_linearized_block_descriptor(this->cfs_inode_attribute->st_size));
+}
+
+void cfs::cfs_inode_service_t::extend_unblocked(const uint64_t new_size)
+{
+    cfs_assert_simple(new_size > static_cast<uint64_t>(this->cfs_inode_attribute->st_size));
+    const auto old_descriptor = size_to_linearized_block_descriptor(this->cfs_inode_attribute->st_size);
+    const auto new_descriptor = size_to_linearized_block_descriptor(new_size);
+    const auto map = cached_block_map(); // fetch before st_size changes
+
+    if (new_descriptor.level3_pointers > old_descriptor.level3_pointers)
+    {
+        // allocate tail blocks, contiguous and right after the current last block when the bitmap allows it
+        const auto goal = old_descriptor.level3_pointers != 0
+            ? block_manager_->storage_goal(resolve_block(old_descriptor.level3_pointers - 1))
+            : UINT64_MAX;
+        const auto new_blocks = allocate_blocks(new_descriptor.level3_pointers - old_descriptor.level3_pointers, STORAGE_BLOCK, goal);
+        pointer_patches_t level3_patches;
+        level3_patches.reserve(new_blocks.size());
+        for (uint64_t i = 0; i < new_blocks.size(); i++) {
+            level3_patches.emplace_back(old_descriptor.level3_pointers + i, new_blocks[i]);
+        }
+
+        patch_pointer_tree(level3_patches, old_descriptor);
+    }
+
+    this->cfs_inode_attribute->st_size = static_cast<decltype(this->cfs_inode_attribute->st_size)>(new_size);
+    if (map != nullptr) {
+        map->st_size = new_size; // pointers were put by patch_pointer_tree() already
+    }
+}
+
+cfs::cfs_inode_service_t::linearized_block_t cfs::cfs_inode_service_t::linearize_all_blocks_from_disk()
 {
     const auto descriptor = size_to_linearized_block_descriptor(this->cfs_inode_attribute->st_size);
     std::vector < uint64_t > level1_pointers;
@@ -464,11 +2074,11 @@ cfs::cfs_inode_service_t::linearized_block_t cfs::cfs_inode_service_t::linearize
         uint64_t index = 0;
         std::ranges::for_each(upper, [&](const uint64_t pointer)
         {
-            const auto lock = lock_page(pointer, true);
-            const auto length = std::min(lock->size(), (pointers - ret.size()) * sizeof(uint64_t));
+            const auto lock = lock_page_shared(pointer, true);
+            const auto length = std::min(lock.size(), (pointers - ret.size()) * sizeof(uint64_t));
             std::vector < uint64_t > new_data;
             new_data.resize(length / sizeof(uint64_t), 0);
-            std::memcpy(new_data.data(), lock->data(), length);
+            std::memcpy(new_data.data(), lock.data(), length);
             ret.insert_range(ret.end(), new_data);
             index++;
         });
@@ -514,8 +2124,18 @@ cfs::cfs_inode_service_t::size_to_linearized_block_descriptor(const uint64_t siz
 cfs::cfs_inode_service_t::allocation_map_t
 cfs::cfs_inode_service_t::reallocate_linearized_block_by_descriptor(const linearized_block_descriptor_t &descriptor)
 {
+    // blocks missing from the current tree are allocated as one range up front and handed out in order
+    std::vector<uint64_t> preallocated;
+    uint64_t next_preallocated = 0;
     auto alloc = [&](const uint8_t blk_type)->uint64_t
     {
+        if (next_preallocated < preallocated.size())
+        {
+            const auto blk = preallocated[next_preallocated++];
+            block_attribute_->set<block_type>(blk, blk_type);
+            return blk;
+        }
+
         const auto blk = block_manager_->allocate();
         block_attribute_->set<block_type>(blk, blk_type);
         return blk;
@@ -571,6 +2191,18 @@ cfs::cfs_inode_service_t::reallocate_linearized_block_by_descriptor(const linear
     std::vector<std::unique_ptr<smart_reallocate_func_t>> level2 = register_into_list(level2_vec, POINTER_BLOCK);
     std::vector<std::unique_ptr<smart_reallocate_func_t>> level3 = register_into_list(level3_vec, STORAGE_BLOCK);
 
+    auto missing = [](const uint64_t wanted, const uint64_t existing)->uint64_t {
+        return wanted > existing ? wanted - existing : 0;
+    };
+
+    if (const auto count = missing(descriptor.level1_pointers, level1.size())
+            + missing(descriptor.level2_pointers, level2.size())
+            + missing(descriptor.level3_pointers, level3.size());
+        count != 0)
+    {
+        preallocated = allocate_blocks(count, STORAGE_BLOCK); // retyped by alloc()
+    }
+
     level1.resize(descriptor.level1_pointers);
     level2.resize(descriptor.level2_pointers);
     level3.resize(descriptor.level3_pointers);
@@ -616,14 +2248,8 @@ void cfs::cfs_inode_service_t::commit_from_linearized_block(allocation_map_t des
                     upper[block_offset].first = new_parent;
                 }
                 std::memcpy(parent_blk_lock->data(), block_data.data(), block_data.size() * sizeof(uint64_t));
-                if (new_parent != parent_blk)
-                {
-                    if (block_attribute_->get<block_status>(parent_blk) == BLOCK_AVAILABLE_TO_MODIFY_0x00) {
-                        block_attribute_->move<block_type, block_type_cow>(parent_blk);
-                        block_attribute_->set<block_type>(parent_blk, COW_REDUNDANCY_BLOCK); // mark the old one as freeable CoW redundancy
-                    } else {
-                        block_attribute_->dec<index_node_referencing_number>(parent_blk);
-                    }
+                if (new_parent != parent_blk) {
+                    retire_block(parent_blk);
                 }
             }
 
@@ -658,6 +2284,8 @@ void cfs::cfs_inode_service_t::commit_from_linearized_block(allocation_map_t des
             this->cfs_level_1_indexes[offset++] = relc.first;
         });
     }
+
+    update_block_map(descriptor);
 }
 
 void cfs::cfs_inode_service_t::commit_from_block_descriptor(const linearized_block_descriptor_t &descriptor)
@@ -668,9 +2296,17 @@ void cfs::cfs_inode_service_t::commit_from_block_descriptor(const linearized_blo
 void cfs::cfs_inode_service_t::resize_unblocked(const uint64_t new_size)
 {
     if (new_size == this->cfs_inode_attribute->st_size) return; // skip size change if no size change is intended
+    if (new_size > this->cfs_inode_attribute->st_size) {
+        extend_unblocked(new_size); // append, no need to touch existing blocks
+        return;
+    }
+
     const auto descriptor = size_to_linearized_block_descriptor(new_size);
     commit_from_block_descriptor(descriptor);
     this->cfs_inode_attribute->st_size = static_cast<decltype(this->cfs_inode_attribute->st_size)>(new_size);
+    if (block_map_ != nullptr) {
+        block_map_->st_size = new_size; // map was just rebuilt for this size
+    }
 }
 
 cfs::cfs_inode_service_t::cfs_inode_service_t(
@@ -696,6 +2332,7 @@ cfs::cfs_inode_service_t::cfs_inode_service_t(
 cfs::cfs_inode_service_t::~cfs_inode_service_t()
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    release_before_images(); // left behind by a write that threw
     if (!!std::memcpy(before_.data(), inode_effective_lock_.data(), inode_effective_lock_.size())) {
         block_attribute_->set<block_checksum>(block_index_,
             utils::arithmetic::hash5(reinterpret_cast<uint8_t *>(inode_effective_lock_.data()), inode_effective_lock_.size())
@@ -712,36 +2349,29 @@ uint64_t cfs::cfs_inode_service_t::read(char * data, uint64_t size, const uint64
         size = this->cfs_inode_attribute->st_size - offset; // resize when short read
     }
 
-    const auto [level1, level2, level3] = linearize_all_blocks();
-    const auto skipped_blocks = offset / block_size_;
-    const auto skipped_bytes = offset % block_size_;
-    const auto bytes_to_read_in_the_first_block = std::min(size, block_size_ - skipped_bytes);
-    const auto bytes_to_read_in_the_following_blocks = size - bytes_to_read_in_the_first_block;
-    const auto adjacent_full_blocks = bytes_to_read_in_the_following_blocks / block_size_;
-    const auto bytes_to_read_in_the_last_block = bytes_to_read_in_the_following_blocks % block_size_;
-    uint64_t global_read_offset = 0;
-    auto copy_to_buffer = [&](const void * ptr, const uint64_t r_size)
-    {
-        std::memcpy(data + global_read_offset, ptr, r_size);
-        global_read_offset += r_size;
-    };
+    if (size == 0) return 0;
 
-    // read first page
+    const auto first_block = offset / block_size_;
+    const auto last_block = (offset + size - 1) / block_size_;
+    const auto map = block_map(); // pointer tree is walked once, later reads take it from the block map cache
+    const auto & storage_blocks = map->level3_pointers;
+    uint64_t skipped_bytes = offset % block_size_;
+    uint64_t global_read_offset = 0;
+    for (uint64_t logical_block = first_block; logical_block <= last_block;)
     {
-        const auto lock1 = lock_page(level3[skipped_blocks]);
-        copy_to_buffer(lock1->data() + skipped_bytes, bytes_to_read_in_the_first_block);
-    }
-
-    // read continuous
-    for (uint64_t i = 1; i <= adjacent_full_blocks; i++) {
-        const auto lock = lock_page(level3[skipped_blocks + i]);
-        copy_to_buffer(lock->data(), block_size_);
-    }
+        // storage blocks laid out next to each other are locked and copied in one go
+        const auto start = storage_blocks[logical_block];
+        uint64_t run = 1;
+        while (logical_block + run <= last_block && storage_blocks[logical_block + run] == start + run) {
+            run++;
+        }
 
-    // read tail
-    if (bytes_to_read_in_the_last_block != 0) {
-        const auto lock = lock_page(level3[skipped_blocks + adjacent_full_blocks + 1]);
-        copy_to_buffer(lock->data(), bytes_to_read_in_the_last_block);
+        const auto lock = lock_pages_continuous_shared(start, run);
+        const auto length = std::min(run * block_size_ - skipped_bytes, size - global_read_offset);
+        std::memcpy(data + global_read_offset, lock.data() + skipped_bytes, length);
+        global_read_offset += length;
+        skipped_bytes = 0;
+        logical_block += run;
     }
 
     return global_read_offset;
@@ -763,9 +2393,7 @@ uint64_t cfs::cfs_inode_service_t::write_unblocked(const char *data, const uint6
         }
     }
 
-    const auto [level1, level2, level3] = linearize_all_blocks();
-    allocation_map_t allocation_descriptor;
-    tsl::hopscotch_map<uint64_t, uint64_t> relink_map;
+    std::map<uint64_t, uint64_t> relink_map; // logical block -> new block
     const auto skipped_blocks = offset / block_size_;
     const auto skipped_bytes = offset % block_size_;
     const auto bytes_to_write_in_the_first_block = std::min(size, block_size_ - skipped_bytes);
@@ -783,73 +2411,75 @@ uint64_t cfs::cfs_inode_service_t::write_unblocked(const char *data, const uint6
         global_write_offset += r_size;
     };
 
-    auto cow_write = [&](const uint64_t index, const uint64_t w_size, const uint64_t w_off)
+    // find out which blocks need a redundancy first, so all of them come out of one contiguous range
+    const auto last_logical_block = skipped_blocks + adjacent_full_blocks + (bytes_to_write_in_the_last_block != 0 ? 1 : 0);
+    std::vector<uint64_t> indexes;
+    std::vector<bool> needs_redundancy;
+    indexes.reserve(last_logical_block - skipped_blocks + 1);
+    needs_redundancy.reserve(last_logical_block - skipped_blocks + 1);
+    const bool cow_disabled = parent_fs_governor_->global_control_flags.load().no_pointer_and_storage_cow;
+    uint64_t redundancies = 0;
+    for (uint64_t i = skipped_blocks; i <= last_logical_block; i++)
+    {
+        indexes.push_back(resolve_block(i));
+        needs_redundancy.push_back(!cow_disabled && !modifiable_in_place(indexes.back(), true));
+        redundancies += needs_redundancy.back() ? 1 : 0;
+    }
+
+    // redundancies follow the block in front of the write, so rewritten runs stay sequential
+    const auto redundancy_goal = skipped_blocks != 0 && redundancies != 0
+        ? block_manager_->storage_goal(resolve_block(skipped_blocks - 1))
+        : UINT64_MAX;
+    const auto redundancy_blocks = allocate_blocks(redundancies, STORAGE_BLOCK, redundancy_goal);
+    uint64_t next_redundancy = 0;
+
+    // work out where each block goes first: a redundancy, or in place with a before-image
+    std::vector<uint64_t> targets;
+    targets.reserve(indexes.size());
+    for (uint64_t i = 0; i < indexes.size(); i++)
     {
-        const auto new_blk = copy_on_write(index);
+        const auto index = indexes[i];
+        const auto new_blk = needs_redundancy[i]
+            ? copy_to_redundancy(index, redundancy_blocks[next_redundancy++])
+            : index;
+        if (new_blk == index && !cow_disabled) {
+            keep_before_image(index);
+        }
         if (new_blk != index) {
             // relink
-            relink_map.emplace(index, new_blk);
-        }
-
-        const auto lock = lock_page(new_blk);
-        copy_to_buffer(lock->data() + w_off, w_size);
-        if (new_blk != index)
-        {
-            if (block_attribute_->get<block_status>(index) == BLOCK_AVAILABLE_TO_MODIFY_0x00) {
-                block_attribute_->move<block_type, block_type_cow>(index);
-                block_attribute_->set<block_type>(index, COW_REDUNDANCY_BLOCK); // mark the old one as freeable CoW redundancy
-            } else {
-                block_attribute_->dec<index_node_referencing_number>(index);
-            }
+            relink_map.emplace(skipped_blocks + i, new_blk);
         }
-    };
+        targets.push_back(new_blk);
+    }
 
-    auto init_alloc_map_from_vec = [&](const std::vector<uint64_t> & list,
-        decltype(allocation_map_t::level1_pointers) & pointer_list)
+    // blocks laid out next to each other are locked and written in one go
+    uint64_t skipped = skipped_bytes;
+    for (uint64_t i = 0; i < targets.size();)
     {
-        std::ranges::for_each(list, [&](const uint64_t ptr) {
-            pointer_list.emplace_back(ptr, false);
-        });
-    };
-
-    // init allocation map
-    init_alloc_map_from_vec(level1, allocation_descriptor.level1_pointers);
-    init_alloc_map_from_vec(level2, allocation_descriptor.level2_pointers);
-    init_alloc_map_from_vec(level3, allocation_descriptor.level3_pointers);
+        uint64_t run = 1;
+        while (i + run < targets.size() && targets[i + run] == targets[i] + run) {
+            run++;
+        }
 
-    // write first page
-    {
-        const auto target_blk = level3[skipped_blocks];
-        cow_write(target_blk, bytes_to_write_in_the_first_block, skipped_bytes);
+        const auto lock = lock_pages_continuous(targets[i], run);
+        copy_to_buffer(lock->data() + skipped, std::min(run * block_size_ - skipped, size - global_write_offset));
+        skipped = 0;
+        i += run;
     }
 
-    // write continuous
-    for (uint64_t i = 1; i <= adjacent_full_blocks; i++) {
-        const auto target_blk = level3[skipped_blocks + i];
-        cow_write(target_blk, block_size_, 0);
+    for (uint64_t i = 0; i < targets.size(); i++) {
+        if (targets[i] != indexes[i]) {
+            retire_block(indexes[i]);
+        }
     }
 
-    // write tail
-    if (bytes_to_write_in_the_last_block != 0) {
-        const auto target_blk = level3[skipped_blocks + adjacent_full_blocks + 1];
-        cow_write(target_blk, bytes_to_write_in_the_last_block, 0);
+    if (!relink_map.empty()) {
+        relink_storage_blocks(relink_map); // commit changes
     }
 
-    if (!relink_map.empty())
-    {
-        // decltype(allocation_descriptor.level3_pointers) level3_pointers = allocation_descriptor.level3_pointers;
-
-        // relink all level 3 blocks
-        std::ranges::for_each(allocation_descriptor.level3_pointers, [&](std::pair <uint64_t, bool> & ptr)
-        {
-            if (const auto it = relink_map.find(ptr.first); it != relink_map.end()) {
-                ptr.first = it->second; // replace parent
-                ptr.second = true; // mark as reallocated
-            }
-        });
-
-        // commit changes
-        commit_from_linearized_block(allocation_descriptor);
+    // everything is in place, the hole write inside is part of this write
+    if (!hole_write) {
+        release_before_images();
     }
 
     success = true;
@@ -859,7 +2489,11 @@ uint64_t cfs::cfs_inode_service_t::write_unblocked(const char *data, const uint6
 void cfs::cfs_inode_service_t::resize(const uint64_t new_size)
 {
     std::lock_guard<std::mutex> lock(mutex_);
+    bool success = false;
+    g_transaction(journal_, success, GlobalTransaction_Major_ResizeInode, this->cfs_inode_attribute->st_ino, new_size);
     resize_unblocked(new_size);
+    release_before_images();
+    success = true;
 }
 
 void cfs::cfs_inode_service_t::chdev(const dev_t dev)
@@ -880,6 +2514,12 @@ void cfs::cfs_inode_service_t::chmod(const mode_t mode)
     this->cfs_inode_attribute->st_mode = mode;
 }
 
+void cfs::cfs_inode_service_t::chflags(const uint32_t flags)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    this->cfs_inode_attribute->st_flags = flags;
+}
+
 void cfs::cfs_inode_service_t::chown(const uid_t uid, const gid_t gid)
 {
     std::lock_guard<std::mutex> lock(mutex_);
@@ -125,6 +125,11 @@ void cfs::inode_t::copy_on_write() // CoW entry
     cfs_assert_simple(inode_construct_info_.block_attribute->get<block_status>(current_referenced_inode_)
         != BLOCK_FROZEN_AND_IS_ENTRY_POINT_OF_SNAPSHOTS_0x01);
 
+    // nothing committed can see me, or no snapshot can and overwrite-if-exclusive is on
+    if (referenced_inode_->modifiable_in_place(current_referenced_inode_)) {
+        return;
+    }
+
     const std::vector<uint8_t> my_data = dump_inode_raw();
     if (parent_inode_ != nullptr)
     {
@@ -135,6 +140,8 @@ void cfs::inode_t::copy_on_write() // CoW entry
             const auto old_ = current_referenced_inode_;
             current_referenced_inode_ = new_inode_num_; // get new inode
             referenced_inode_.reset();
+            // same pointers in the new inode, carry the block map over
+            inode_construct_info_.block_manager->block_map_cache().relocate(old_, new_inode_num_);
             referenced_inode_ = std::make_unique<cfs_inode_service_t>(new_inode_num_,
                                                                       inode_construct_info_.parent_fs_governor,
                                                                       inode_construct_info_.block_manager,
@@ -158,15 +165,15 @@ void cfs::inode_t::copy_on_write() // CoW entry
     }
 }
 
-void cfs::inode_t::root_cow()
+void cfs::inode_t::root_cow(const bool rewrite_bitmap)
 {
     if (inode_construct_info_.parent_fs_governor->global_control_flags.load().no_pointer_and_storage_cow) {
         return;
     }
 
-    std::vector<uint8_t> data_;
     // create a new block
-    const auto new_inode_num_ = inode_construct_info_.block_manager->allocate();
+    const auto new_inode_num_ = inode_construct_info_.block_manager->allocate(
+        inode_construct_info_.block_manager->metadata_goal(current_referenced_inode_));
     // set attributes
     inode_construct_info_.block_attribute->set<block_type>(new_inode_num_, INDEX_NODE_BLOCK);
 
@@ -180,6 +187,7 @@ void cfs::inode_t::root_cow()
     const auto old_ = current_referenced_inode_;
     current_referenced_inode_ = new_inode_num_; // get new inode
     referenced_inode_.reset();
+    inode_construct_info_.block_manager->block_map_cache().relocate(old_, new_inode_num_); // carry the block map over
     referenced_inode_ = std::make_unique<cfs_inode_service_t>(new_inode_num_,
                                                               inode_construct_info_.parent_fs_governor,
                                                               inode_construct_info_.block_manager,
@@ -195,48 +203,56 @@ void cfs::inode_t::root_cow()
     /////////////  \/  \/\_| \_|\___/  \_/ \____/  \_|   \____/   \___/\_| \_/\_|    \___/    //////////////
     ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    // [DENTRY ENTRY POINTER] -> 8 bytes, 64bit pointer
-    // [BITMAP]             -> Compressed
-    // [INODE]              -> Compressed
-    // [STATIC DATA]        -> Uncompressed, placeholder
+    // [DENTRY ENTRY POINTER] -> 8 bytes, 64bit pointer, alone in the first block
+    // [INODE]              -> One block
+    // [STATIC DATA]        -> Uncompressed, attribute map, placeholder
+    // [BITMAP]             -> Uncompressed, bitmap of this root
     // [DENTRY ENTRY]
+    // Every region starts on a block boundary. The new root shares its blocks with the previous one, so
+    // only bitmap pages changed since the previous root are written, and only their blocks are CoW'd.
+    // A root of another layout, or one whose bitmap was not kept in step with the live one, gets all pages.
 
-    const auto bitmap_dump = referenced_inode_->block_manager_->dump_bitmap_data();
-    // const auto attribute_dump = referenced_inode_->block_attribute_->dump();
+    const auto map_bytes = (static_info_->data_bitmap_end - static_info_->data_bitmap_start) * static_info_->block_size;
+    const auto attribute_bytes =
+        (static_info_->data_block_attribute_table_end - static_info_->data_block_attribute_table_start) * static_info_->block_size;
+    const uint64_t metadata_end = static_info_->block_size * 2 + attribute_bytes + map_bytes;
+    const bool whole_bitmap = rewrite_bitmap || dentry_start_ != metadata_end;
+    const auto pages = referenced_inode_->block_manager_->dump_dirty_bitmap_pages(whole_bitmap);
     std::vector<uint8_t> inode_metadata(referenced_inode_->block_size_);
     std::memcpy(inode_metadata.data(), referenced_inode_->inode_effective_lock_.data(),
                 referenced_inode_->inode_effective_lock_.size());
 
-    data_.resize(bitmap_dump.size() /* + attribute_dump.size() */ + inode_metadata.size()); // we keep this buffer
-    /// so that less malloc is called
-    /// data will be overwritten anyway so
-
-    uint64_t offset = 0;
-    auto write_to_buffer = [&](const std::vector<uint8_t> & buffer) {
-        std::memcpy(data_.data() + offset, buffer.data(), buffer.size());
-        offset += buffer.size();
-    };
-
-    write_to_buffer(bitmap_dump);
-    // write_to_buffer(attribute_dump);
-    write_to_buffer(inode_metadata);
-    const auto empty_size =
-        (static_info_->data_block_attribute_table_end - static_info_->data_block_attribute_table_start) * static_info_->block_size + /* attribute map */
-        (static_info_->data_bitmap_end - static_info_->data_bitmap_start) * static_info_->block_size /* bitmap */;
+    dentry_start_ = metadata_end; // so save_dentry_unblocked() knows where to continue
+    referenced_inode_->resize(dentry_start_);
+    if (whole_bitmap) {
+        referenced_inode_->write(reinterpret_cast<char *>(&dentry_start_), sizeof(dentry_start_), 0);
+    }
+    referenced_inode_->write(reinterpret_cast<const char *>(inode_metadata.data()), inode_metadata.size(), static_info_->block_size);
 
-    const auto data_compressed = utils::arithmetic::compress(data_);
-    dentry_start_ = data_compressed.size() + sizeof(dentry_start_) + empty_size; // so save_dentry_unblocked() knows where to continue
+    // pages next to each other go out in one write
+    std::vector<uint8_t> run;
+    uint64_t run_start = 0;
+    for (auto page = pages.begin(); page != pages.end(); ++page)
+    {
+        if (run.empty()) {
+            run_start = page->first;
+        }
 
-    offset = 0;
+        run.insert(run.end(), page->second.begin(), page->second.end());
+        if (const auto next = std::next(page); next == pages.end() || next->first != page->first + 1)
+        {
+            referenced_inode_->write(reinterpret_cast<const char *>(run.data()), run.size(),
+                metadata_end - map_bytes + run_start * static_info_->block_size);
+            run.clear();
+        }
+    }
 
-    referenced_inode_->resize(dentry_start_);
-    offset += referenced_inode_->write(reinterpret_cast<char *>(&dentry_start_), sizeof(uint64_t), offset);
-    offset += referenced_inode_->write(reinterpret_cast<const char *>(data_compressed.data()), data_compressed.size(), offset);
     /// Now, we have written all the metadata:
     save_dentry_unblocked();
 
     // relink root
     inode_construct_info_.parent_fs_governor->cfs_header_block.set_info<root_inode_pointer>(new_inode_num_);
+    inode_construct_info_.block_manager->commit_bitmap_periodically(); // mirror follows the root every few seconds
     referenced_inode_->cfs_inode_attribute->st_ino = new_inode_num_;
 
     // change old to redundancy
@@ -266,7 +282,8 @@ uint64_t cfs::inode_t::copy_on_write_invoked_from_child(const uint64_t cow_index
     dentry_map_.erase(ptr_);
 
     // copy over
-    const auto new_block = inode_construct_info_.block_manager->allocate();
+    const auto new_block = inode_construct_info_.block_manager->allocate(
+        inode_construct_info_.block_manager->metadata_goal(cow_index));
     inode_construct_info_.block_attribute->set<block_type>(new_block, INDEX_NODE_BLOCK);
     const auto new_lock = referenced_inode_->lock_page(new_block);
     cfs_assert_simple(content.size() == static_info_->block_size);
@@ -349,6 +366,13 @@ void cfs::inode_t::chmod(const mode_t mode)
     return referenced_inode_->chmod(mode);
 }
 
+void cfs::inode_t::chflags(const uint32_t flags)
+{
+    std::lock_guard lock(operation_mutex_);
+    copy_on_write(); // relink
+    return referenced_inode_->chflags(flags);
+}
+
 void cfs::inode_t::chown(const uid_t uid, const gid_t gid)
 {
     std::lock_guard lock(operation_mutex_);
@@ -389,6 +413,23 @@ cfs::stat cfs::inode_t::get_stat()
     return get_stat_unblocked();
 }
 
+std::vector<uint8_t> cfs::inode_t::read_root_bitmap_unblocked() const
+{
+    // bitmap is the last region before the dentry, see root_cow()
+    const uint64_t map_bytes = (static_info_->data_bitmap_end - static_info_->data_bitmap_start) * static_info_->block_size;
+    cfs_assert_simple(dentry_start_ >= map_bytes);
+    std::vector<uint8_t> bitmap_data(map_bytes);
+    const auto rSize = referenced_inode_->read(reinterpret_cast<char *>(bitmap_data.data()), map_bytes, dentry_start_ - map_bytes);
+    cfs_assert_simple(rSize == map_bytes);
+    return bitmap_data;
+}
+
+std::vector<uint8_t> cfs::inode_t::read_root_bitmap()
+{
+    std::lock_guard lock(operation_mutex_);
+    return read_root_bitmap_unblocked();
+}
+
 cfs::dentry_t::dentry_t(
     const uint64_t index,
     filesystem *parent_fs_governor,
@@ -494,13 +535,13 @@ void cfs::dentry_t::snapshot(const std::string &name)
     }
 
     std::lock_guard<std::mutex> lock(operation_mutex_);
-    copy_on_write();
+    inode_construct_info_.block_manager->transaction_group().commit(); // everything before snapshot is sealed
     cfs_assert_simple(parent_inode_ == nullptr);
+    root_cow(); // never in place, snapshot data goes to static data region reserved by root CoW
     bool success = false;
     g_transaction(inode_construct_info_.journal, success, GlobalTransaction_Major_SnapshotCreation);
     std::vector<uint8_t> root_raw_dump;
     uint64_t old_dentry_start_ = 0;
-    std::vector<uint64_t> level3s;
 
     uint64_t new_inode_index = 0;
     {
@@ -510,11 +551,10 @@ void cfs::dentry_t::snapshot(const std::string &name)
         new_inode.write(reinterpret_cast<char *>(root_raw_dump.data()), root_raw_dump.size(), 0);
         new_inode_index = new_inode.current_referenced_inode_;
         old_dentry_start_ = dentry_start_;
-        const auto [lv1, lv2, lv3] = new_inode.referenced_inode_->linearize_all_blocks();
-        level3s = lv3;
     }
 
     // force CoW updates from now on
+    inode_construct_info_.block_manager->transaction_group().commit();
     for (uint64_t i = 0; i < static_info_->data_table_end - static_info_->data_table_start; i++)
     {
         const auto attr = inode_construct_info_.block_attribute->get(i);
@@ -557,31 +597,18 @@ void cfs::dentry_t::snapshot(const std::string &name)
     save_dentry_unblocked();
 
     // dump bitmap
-    const auto map_size = static_info_->data_table_end - static_info_->data_table_start;
     auto bitmap_dump = inode_construct_info_.block_manager->dump_bitmap_data();
     // remove all cow blocks from this bitmap
-    class per_snapshot_bitmap_t : public bitmap_base {
-    public:
-        explicit per_snapshot_bitmap_t(uint8_t * data, const uint64_t size)
-        {
-            init_data_array = [&](const uint64_t)->bool
-            {
-                data_array_ = data;
-                return true;
-            };
-
-            init(size);
-        }
-    } per_snapshot_bitmap(bitmap_dump.data(), // bitmap start
-        map_size); // particles. bytes are calculated automatically
-
-    for (uint64_t i = 0; i < map_size; i++) {
-        if (per_snapshot_bitmap.get_bit(i) && inode_construct_info_.block_attribute->get<block_type>(i) == COW_REDUNDANCY_BLOCK) {
-            per_snapshot_bitmap.set_bit(i, false); // remove it when it's just CoW
-        }
-    }
+    inode_construct_info_.block_attribute->remove_if(bitmap_dump,
+        [](const cfs_block_attribute_t & attr) { return attr.block_type == COW_REDUNDANCY_BLOCK; });
 
-    auto replace_write = [this, &level3s](const std::vector<uint8_t> & data, const uint64_t offset)
+    // snapshot entry is final now, resolve its blocks directly
+    cfs_inode_service_t snapshot_inode(new_inode_index,
+        inode_construct_info_.parent_fs_governor,
+        inode_construct_info_.block_manager,
+        inode_construct_info_.journal,
+        inode_construct_info_.block_attribute);
+    auto replace_write = [this, &snapshot_inode](const std::vector<uint8_t> & data, const uint64_t offset)
     {
         const uint64_t bytes = data.size();
         const uint64_t start = offset;
@@ -596,7 +623,8 @@ void cfs::dentry_t::snapshot(const std::string &name)
 
         uint64_t src_offset = 0;
         auto replace_write_sig = [&](const uint64_t block, const uint64_t size, const uint64_t w_off) {
-            const auto blk_lock = inode_construct_info_.parent_fs_governor->lock(level3s[block] + static_info_->data_table_start);
+            const auto blk_lock = inode_construct_info_.parent_fs_governor->lock(
+                snapshot_inode.resolve_block(block) + static_info_->data_table_start);
             std::memcpy(blk_lock.data() + w_off, data.data() + src_offset, size);
             src_offset += size;
         };
@@ -628,20 +656,21 @@ void cfs::dentry_t::snapshot(const std::string &name)
     const auto attribute_dump = inode_construct_info_.block_attribute->dump();
     replace_write(attribute_dump, old_dentry_start_ - map_bytes - bytes_by_attribute_map);
 
-    // then we mark again to mask any missing ones during CoW
-    for (uint64_t i = 0; i < static_info_->data_table_end - static_info_->data_table_start; i++)
+    // then we mark again to mask any missing ones during CoW.
+    // blocks without references get references again, the reclaimer must not free them meanwhile
     {
-        const auto attr = inode_construct_info_.block_attribute->get(i);
-        if (inode_construct_info_.block_manager->blk_at(i))
-        {
-            if (attr.block_status == BLOCK_AVAILABLE_TO_MODIFY_0x00) {
-                inode_construct_info_.block_attribute->set<block_status>(i, BLOCK_FROZEN_AND_IS_SNAPSHOT_REGULAR_BLOCK_0x02);
-            }
+        const auto gate = inode_construct_info_.block_manager->reclaimer().hold();
+        inode_construct_info_.block_attribute->update_each(inode_construct_info_.block_manager->dump_bitmap_data(),
+            [](cfs_block_attribute_t & attr)
+            {
+                if (attr.block_status == BLOCK_AVAILABLE_TO_MODIFY_0x00) {
+                    attr.block_status = BLOCK_FROZEN_AND_IS_SNAPSHOT_REGULAR_BLOCK_0x02;
+                }
 
-            if (attr.block_type != COW_REDUNDANCY_BLOCK) {
-                inode_construct_info_.block_attribute->set<index_node_referencing_number>(i, 2); // reset to 2
-            }
-        }
+                if (attr.block_type != COW_REDUNDANCY_BLOCK) {
+                    attr.index_node_referencing_number = 2; // reset to 2
+                }
+            });
     }
 
     // set new inode as snapshot entry point
@@ -660,6 +689,7 @@ void cfs::dentry_t::revert(const std::string &name)
 
     std::lock_guard<std::mutex> lock(operation_mutex_);
     cfs_assert_simple(parent_inode_ == nullptr); // force root
+    inode_construct_info_.block_manager->transaction_group().commit();
     bool success = false;
     g_transaction(inode_construct_info_.journal, success, GlobalTransaction_Major_SnapshotCreation);
 
@@ -667,16 +697,14 @@ void cfs::dentry_t::revert(const std::string &name)
     cfs_assert_simple(ptr != dentry_map_.end());
 
     // remove all post snapshot changes
-    for (uint64_t i = 0; i < static_info_->data_table_end - static_info_->data_table_start; i++)
-    {
-        if (inode_construct_info_.block_manager->blk_at(i))
+    inode_construct_info_.block_attribute->update_each(inode_construct_info_.block_manager->dump_bitmap_data(),
+        [](cfs_block_attribute_t & attr)
         {
-            if (inode_construct_info_.block_attribute->get<block_status>(i) == BLOCK_AVAILABLE_TO_MODIFY_0x00) {
-                inode_construct_info_.block_attribute->move<block_type, block_type_cow>(i);
-                inode_construct_info_.block_attribute->set<block_type>(i, COW_REDUNDANCY_BLOCK);
+            if (attr.block_status == BLOCK_AVAILABLE_TO_MODIFY_0x00) {
+                attr.block_type_cow = attr.block_type;
+                attr.block_type = COW_REDUNDANCY_BLOCK;
             }
-        }
-    }
+        });
 
     // backup snapshot entries
     std::vector < std::pair < std::string, uint64_t > > snapshot_entry_list;
@@ -701,7 +729,7 @@ void cfs::dentry_t::revert(const std::string &name)
     dentry_map_.clear();
     dentry_map_reversed_search_map_.clear();
     read_dentry_unblocked();
-    root_cow(); // force a CoW to redirect root, skip check (we will discard)
+    root_cow(true); // force a CoW to redirect root, skip check (we will discard). bitmap kept is the snapshot's, replace it
 
     // add missing snapshot entry link
     for (const auto & [pointer_name, pointer] : snapshot_entry_list)
@@ -714,30 +742,26 @@ void cfs::dentry_t::revert(const std::string &name)
 
     save_dentry_unblocked(); // save on disk
 
-    // reset reference state
-    for (uint64_t i = 0; i < static_info_->data_table_end - static_info_->data_table_start; i++)
+    // reset reference state, under the reclaimer gate like in snapshot()
+    inode_construct_info_.block_manager->transaction_group().commit();
     {
-        const auto attr = inode_construct_info_.block_attribute->get(i);
-        if (inode_construct_info_.block_manager->blk_at(i))
-        {
-            if (attr.block_status == BLOCK_AVAILABLE_TO_MODIFY_0x00) {
-                inode_construct_info_.block_attribute->set<block_status>(i, BLOCK_FROZEN_AND_IS_SNAPSHOT_REGULAR_BLOCK_0x02);
-            }
+        const auto gate = inode_construct_info_.block_manager->reclaimer().hold();
+        inode_construct_info_.block_attribute->update_each(inode_construct_info_.block_manager->dump_bitmap_data(),
+            [](cfs_block_attribute_t & attr)
+            {
+                if (attr.block_status == BLOCK_AVAILABLE_TO_MODIFY_0x00) {
+                    attr.block_status = BLOCK_FROZEN_AND_IS_SNAPSHOT_REGULAR_BLOCK_0x02;
+                }
 
-            if (attr.block_type != COW_REDUNDANCY_BLOCK) {
-                inode_construct_info_.block_attribute->set<index_node_referencing_number>(i, 2);
-            }
-        }
+                if (attr.block_type != COW_REDUNDANCY_BLOCK) {
+                    attr.index_node_referencing_number = 2;
+                }
+            });
     }
 
-    uint64_t non_cow_blocks = 0;
-    for (uint64_t i = 0; i < static_info_->data_table_end - static_info_->data_table_start; i++)
-    {
-        const auto attr = inode_construct_info_.block_attribute->get(i);
-        if (inode_construct_info_.block_manager->blk_at(i)) {
-            non_cow_blocks += (attr.block_type != 0x00) ? 1 : 0;
-        }
-    }
+    const uint64_t non_cow_blocks = inode_construct_info_.block_attribute->count_if(
+        inode_construct_info_.block_manager->dump_bitmap_data(),
+        [](const cfs_block_attribute_t & attr) { return attr.block_type != 0x00; });
 
     inode_construct_info_.parent_fs_governor->cfs_header_block.set_info<allocated_non_cow_blocks>(non_cow_blocks);
     inode_construct_info_.parent_fs_governor->sync(); // sync when snapshot
@@ -751,8 +775,9 @@ void cfs::dentry_t::delete_snapshot(const std::string &name)
     }
 
     std::lock_guard<std::mutex> lock(operation_mutex_);
-    copy_on_write();
+    inode_construct_info_.block_manager->transaction_group().commit();
     cfs_assert_simple(parent_inode_ == nullptr);
+    root_cow(); // never in place, see snapshot()
     bool success = false;
     g_transaction(inode_construct_info_.journal, success, GlobalTransaction_Major_SnapshotCreation);
 
@@ -878,13 +903,10 @@ void cfs::dentry_t::delete_snapshot(const std::string &name)
         }
 
         const uint64_t map_bytes = (static_info_->data_bitmap_end - static_info_->data_bitmap_start) * static_info_->block_size;
-        const uint64_t map_start = dentry->dentry_start_ - map_bytes;
         const uint64_t attr_bytes = (static_info_->data_block_attribute_table_end - static_info_->data_block_attribute_table_start) * static_info_->block_size;
         const uint64_t attr_start = dentry->dentry_start_ - attr_bytes - map_bytes;
 
-        std::vector<uint8_t> bitmap_data(map_bytes);
-        dentry->referenced_inode_->read(reinterpret_cast<char *>(bitmap_data.data()), map_bytes, map_start);
-        bitmaps_from_all_snapshots.emplace(snapshot_entry_index, bitmap_data);
+        bitmaps_from_all_snapshots.emplace(snapshot_entry_index, dentry->read_root_bitmap_unblocked());
 
         std::vector<uint8_t> attributes_data(attr_bytes);
         dentry->referenced_inode_->read(reinterpret_cast<char *>(attributes_data.data()), attr_bytes, attr_start);
@@ -1043,6 +1065,10 @@ void cfs::dentry_t::delete_snapshot(const std::string &name)
         std::function<void(uint64_t)> venture_from_one_entry;
         venture_from_one_entry = [&](const uint64_t index)
         {
+            if (this_root_bitmap.exchange_bit(index, true)) {
+                return; // reached through another link already
+            }
+
             mode_t mode = 0;
             {
                 cfs_inode_service_t inode(index, inode_construct_info_.parent_fs_governor,
@@ -1058,8 +1084,6 @@ void cfs::dentry_t::delete_snapshot(const std::string &name)
             } else {
                 venture_non_dentry(index);
             }
-
-            this_root_bitmap.set_bit(index, true);
         };
 
         // mark all children except entry point
@@ -1084,30 +1108,31 @@ void cfs::dentry_t::delete_snapshot(const std::string &name)
         mark({ current_referenced_inode_ });
 
         // now, this_root_bitmap contains data that only referenced by root, remove all other data
-        for (uint64_t i = 0; i < map_size; i++)
+        auto unreferenced_by_root = inode_construct_info_.block_manager->dump_bitmap_data();
+        for (uint64_t i = 0; i < std::min(unreferenced_by_root.size(), actual_blocks_used_by_real_root.size()); i++) {
+            unreferenced_by_root[i] &= static_cast<uint8_t>(~actual_blocks_used_by_real_root[i]);
+        }
+
+        // allocated, non-redundancy, BUT!, not present in root tree in any way or form
+        inode_construct_info_.block_attribute->update_each(unreferenced_by_root, [](cfs_block_attribute_t & attr)
         {
-            if (inode_construct_info_.block_manager->blk_at(i)
-                && inode_construct_info_.block_attribute->get<block_type>(i) != COW_REDUNDANCY_BLOCK
-                && !this_root_bitmap.get_bit(i))
-            {
-                // allocated, non-redundancy, BUT!, not present in root tree in any way or form
-                delete_blocks({i}); // mark this block as redundancy
+            if (attr.block_type != COW_REDUNDANCY_BLOCK) {
+                attr.block_type_cow = attr.block_type; // backup block type
+                attr.block_type = COW_REDUNDANCY_BLOCK; // mark this block as redundancy
             }
-        }
+        });
 
         // since we skipped snapshot entry points, that means no additional cleanups are needed
         // they are never referenced in the root, so they will never be added into the bitmap
         // and the above step already freed all unmarked data in the root reference
 
-        // mark all remaining as 1 ref, available to be modified
-        for (uint64_t i = 0; i < map_size; i++)
+        // mark all remaining as 1 ref, available to be modified, under the reclaimer gate like in snapshot()
+        const auto gate = inode_construct_info_.block_manager->reclaimer().hold();
+        inode_construct_info_.block_attribute->update_each(actual_blocks_used_by_real_root, [](cfs_block_attribute_t & attr)
         {
-            if (this_root_bitmap.get_bit(i))
-            {
-                inode_construct_info_.block_attribute->set<index_node_referencing_number>(i, 1);
-                inode_construct_info_.block_attribute->set<block_status>(i, BLOCK_AVAILABLE_TO_MODIFY_0x00);
-            }
-        }
+            attr.index_node_referencing_number = 1;
+            attr.block_status = BLOCK_AVAILABLE_TO_MODIFY_0x00;
+        });
     }
     else // first gen, later is not root, all nodes are referenced unfortunately until in the last gen we do a proper clean up
     {
@@ -1127,14 +1152,9 @@ void cfs::dentry_t::delete_snapshot(const std::string &name)
 
     // static field. no CoW after this
     // update corresponding flags
-    uint64_t non_cow_blocks = 0;
-    for (uint64_t i = 0; i < map_size; i++)
-    {
-        const auto attr = inode_construct_info_.block_attribute->get(i);
-        if (inode_construct_info_.block_manager->blk_at(i)) {
-            non_cow_blocks += (attr.block_type != 0x00) ? 1 : 0;
-        }
-    }
+    const uint64_t non_cow_blocks = inode_construct_info_.block_attribute->count_if(
+        inode_construct_info_.block_manager->dump_bitmap_data(),
+        [](const cfs_block_attribute_t & attr) { return attr.block_type != 0x00; });
 
     inode_construct_info_.parent_fs_governor->cfs_header_block.set_info<allocated_non_cow_blocks>(non_cow_blocks);
     inode_construct_info_.parent_fs_governor->sync(); // sync
@@ -20,11 +20,12 @@ namespace cfs::basic_io
         }
     }
 
-    void mmap::open(const std::string& file)
+    void mmap::open(const std::string& file, const bool read_only)
     {
-        fd = ::open(file.c_str(), O_RDWR);
+        read_only_ = read_only;
+        fd = ::open(file.c_str(), read_only ? O_RDONLY : O_RDWR);
         if (fd == -1) {
-            throw error::BasicIOcannotOpenFile("invalid fd returned by ::open(\"", file, "\", O_RDWR)");
+            throw error::BasicIOcannotOpenFile("invalid fd returned by ::open(\"", file, "\", ", read_only ? "O_RDONLY" : "O_RDWR", ")");
         }
 
         struct stat st = { };
@@ -32,8 +33,8 @@ namespace cfs::basic_io
             throw error::BasicIOcannotOpenFile("fstat failed for file ", file);
         }
 
-        // Map the entire file into virtual address space
-        data_ = static_cast<char*>(::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        // Map the entire file into virtual address space, a private mapping keeps every write to itself
+        data_ = static_cast<char*>(::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, read_only ? MAP_PRIVATE : MAP_SHARED, fd, 0));
 
         if (data_ == MAP_FAILED) {
             throw error::BasicIOcannotOpenFile("mmap failed for file ", file);
@@ -55,6 +56,10 @@ namespace cfs::basic_io
 
     void mmap::sync()
     {
+        if (read_only_) {
+            return; // nothing of a private mapping goes back to the file
+        }
+
         cfs_assert_simple(msync(data_, size_, MS_SYNC) == 0);
         cfs_assert_simple(fsync(fd) == 0);
     }
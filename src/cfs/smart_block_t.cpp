@@ -2,6 +2,7 @@
 #include "utils.h"
 #include <fcntl.h>
 #include <filesystem>
+#include <bit>
 #include <cstdint>
 #include <cstring>
 #include <unistd.h>
@@ -13,54 +14,39 @@ void cfs::bitmap_base::init(const uint64_t required_blocks)
     *const_cast<uint64_t *>(&bytes_required_) = utils::arithmetic::count_cell_with_cell_size(8, required_blocks);
     *const_cast<uint64_t *>(&particles_) = required_blocks;
     cfs_assert_simple(init_data_array(bytes_required_));
+    word_aligned_ = reinterpret_cast<uintptr_t>(data_array_) % std::atomic_ref<uint64_t>::required_alignment == 0;
 }
 
-bool cfs::bitmap_base::get_bit(const uint64_t index, const bool use_mutex)
+// bit n of a word is bit n % 8 of byte n / 8 only on a little endian host
+static_assert(std::endian::native == std::endian::little, "bitmap words assume a little endian host");
+
+bool cfs::bitmap_base::get_bit(const uint64_t index)
 {
     cfs_assert_simple(index < particles_);
-    const uint64_t q = index >> 3;
-    const uint64_t r = index & 7; // div by 8
-    uint8_t c = 0;
-    if (use_mutex) {
-        std::lock_guard<std::mutex> lock(array_mtx_);
-        c = data_array_[q];
-    }
-    else {
-        c = data_array_[q];
+    if (auto * word = word_at(index)) {
+        return std::atomic_ref(*word).load(std::memory_order_acquire) >> (index & 63) & 0x01;
     }
 
-    c >>= r;
-    c &= 0x01;
-    return c;
+    return std::atomic_ref(data_array_[index >> 3]).load(std::memory_order_acquire) >> (index & 7) & 0x01;
 }
 
-void cfs::bitmap_base::set_bit(const uint64_t index, const bool new_bit, const bool use_mutex)
+bool cfs::bitmap_base::exchange_bit(const uint64_t index, const bool new_bit)
 {
     cfs_assert_simple(index < particles_);
-    const uint64_t q = index >> 3;
-    const uint64_t r = index & 7; // div by 8
-    uint8_t c = 0x01;
-    c <<= r;
-
-    auto set = [&]
+    auto exchange = [new_bit]<typename Cell>(Cell & cell, const Cell mask)->bool
     {
-        if (new_bit) // set to true
-        {
-            data_array_[q] |= c;
-        }
-        else // clear bit
-        {
-            data_array_[q] &= ~c;
-        }
+        std::atomic_ref ref(cell);
+        const Cell before = new_bit
+            ? ref.fetch_or(mask, std::memory_order_acq_rel)
+            : ref.fetch_and(static_cast<Cell>(~mask), std::memory_order_acq_rel);
+        return (before & mask) != 0;
     };
 
-    if (use_mutex)
-    {
-        std::lock_guard<std::mutex> lock(array_mtx_);
-        set();
-    } else {
-        set();
+    if (auto * word = word_at(index)) {
+        return exchange(*word, static_cast<uint64_t>(1) << (index & 63));
     }
+
+    return exchange(data_array_[index >> 3], static_cast<uint8_t>(1u << (index & 7)));
 }
 
 namespace solver
@@ -262,6 +248,7 @@ void cfs::make_cfs(const std::string &path_to_block_file, const uint64_t block_s
         .st_dev = 0,
         .st_ino = 0,
         .st_mode = S_IFDIR | 0755,
+        .st_flags = 0,
         .st_nlink = 1,
         .st_uid = getuid(),
         .st_gid = getgid(),
@@ -288,26 +275,6 @@ void cfs::make_cfs(const std::string &path_to_block_file, const uint64_t block_s
     ilog("Sync data...\n");
 }
 
-void cfs::filesystem::block_shared_lock_t::bitmap_t::create(const uint64_t size)
-{
-    init_data_array = [&](const uint64_t bytes)->bool
-    {
-        try {
-            data.resize(bytes, 0);
-            data_array_ = data.data();
-            return true;
-        }
-        catch (cfs::error::assertion_failed &) {
-            throw;
-        }
-        catch (...) {
-            return false;
-        }
-    };
-
-    cfs::bitmap_base::init(size);
-}
-
 cfs::cfs_head_t::runtime_info_t cfs::filesystem::cfs_header_block_t::load()
 {
     auto blk0 = parent_->lock(0);
@@ -340,44 +307,145 @@ cfs::cfs_head_t cfs::filesystem::cfs_header_block_t::get_info()
 
 void cfs::filesystem::block_shared_lock_t::lock(const uint64_t index)
 {
-    auto try_acquire_lock = [&]->bool
+    cfs_assert_simple(index < blocks_);
+    auto & [mutex, cv, held, waiters, writers_queued] = shard(index);
+    std::unique_lock lock(mutex);
+    if (held.contains(index))
     {
-        std::lock_guard lock(bitmap_mtx_);
-        // release_block_id_this_time = UINT64_MAX;
-        if (bitmap.get_bit(index, false)) {
-            return false;
+        // new readers queue up behind us, so a steady stream of them can't keep the block away forever
+        writers_queued[index]++;
+        waiters++;
+        cv.wait(lock, [&]->bool { return !held.contains(index); });
+        waiters--;
+        if (const auto it = writers_queued.find(index); --it.value() == 0) {
+            writers_queued.erase(it);
         }
+    }
 
-        bitmap.set_bit(index, true, false);
-        return true;
-    };
+    held.emplace(index, exclusive_holder);
+}
 
-    while (!try_acquire_lock())
+void cfs::filesystem::block_shared_lock_t::unlock(const uint64_t index)
+{
+    cfs_assert_simple(index < blocks_);
+    auto & [mutex, cv, held, waiters, writers_queued] = shard(index);
+    bool notify;
     {
-        std::unique_lock<std::mutex> lock(bitmap_mtx_);
-        cv.wait(lock, [&]->bool { return !bitmap.get_bit(index, false); });
+        std::lock_guard lock(mutex);
+        held.erase(index);
+        notify = waiters != 0;
+    }
+
+    if (notify) {
+        cv.notify_all(); // only waiters in this shard
     }
 }
 
-void cfs::filesystem::block_shared_lock_t::unlock(const uint64_t index)
+template < typename Func >
+void cfs::filesystem::block_shared_lock_t::for_each_shard_in_range(const uint64_t start, const uint64_t count, Func && func)
 {
-    try {
-        std::lock_guard lock(bitmap_mtx_);
-        bitmap.set_bit(index, false, false);
-        // release_block_id_this_time = index;
+    // the range covers shards start % shard_count onward, wrapping, min(count, shard_count) of them
+    for (uint64_t shard_id = 0; shard_id < shard_count; shard_id++)
+    {
+        // first block in range belonging to this shard
+        const uint64_t skip = (shard_id + shard_count - start % shard_count) % shard_count;
+        if (skip >= count) {
+            continue;
+        }
+
+        func(shards_[shard_id], start + skip);
     }
-    catch (cfs::error::assertion_failed &) {
-        throw;
+}
+
+void cfs::filesystem::block_shared_lock_t::lock_range(const uint64_t start, const uint64_t count, const bool shared)
+{
+    cfs_assert_simple(count <= blocks_ && start <= blocks_ - count);
+    // ascending block index. taken shard by shard, a range wrapping over the last shard would hold block 64
+    // while waiting for 63, and deadlock against a locker holding 63 and waiting for 64
+    for (uint64_t index = start; index < start + count; index++)
+    {
+        if (shared) {
+            lock_shared(index);
+        } else {
+            lock(index);
+        }
     }
-    catch (...) {
+}
+
+void cfs::filesystem::block_shared_lock_t::unlock_range(const uint64_t start, const uint64_t count, const bool shared)
+{
+    cfs_assert_simple(count <= blocks_ && start <= blocks_ - count);
+    for_each_shard_in_range(start, count, [&](shard_t & shard_, const uint64_t first)
+    {
+        auto & [mutex, cv, held, waiters, writers_queued] = shard_;
+        bool notify;
+        {
+            std::lock_guard lock(mutex);
+            for (uint64_t index = first; index < start + count; index += shard_count)
+            {
+                const auto it = held.find(index);
+                cfs_assert_simple(it != held.end());
+                if (!shared || --it.value() == 0) {
+                    held.erase(it);
+                }
+            }
+            notify = waiters != 0;
+        }
+
+        if (notify) {
+            cv.notify_all();
+        }
+    });
+}
+
+void cfs::filesystem::block_shared_lock_t::lock_shared(const uint64_t index)
+{
+    cfs_assert_simple(index < blocks_);
+    auto & [mutex, cv, held, waiters, writers_queued] = shard(index);
+    std::unique_lock lock(mutex);
+    auto writer_ahead = [&]->bool {
+        const auto it = held.find(index);
+        return (it != held.end() && it->second == exclusive_holder) || writers_queued.contains(index);
+    };
+
+    if (writer_ahead())
+    {
+        waiters++;
+        cv.wait(lock, [&]->bool { return !writer_ahead(); });
+        waiters--;
+    }
+
+    if (const auto it = held.find(index); it != held.end()) {
+        it.value()++;
+    } else {
+        held.emplace(index, 1);
     }
-    cv.notify_all();
 }
 
-cfs::filesystem::filesystem(const std::string &path_to_block_file) : static_info_({})
+void cfs::filesystem::block_shared_lock_t::unlock_shared(const uint64_t index)
+{
+    cfs_assert_simple(index < blocks_);
+    auto & [mutex, cv, held, waiters, writers_queued] = shard(index);
+    bool notify = false;
+    {
+        std::lock_guard lock(mutex);
+        const auto it = held.find(index);
+        cfs_assert_simple(it != held.end() && it->second > 0);
+        if (--it.value() == 0) {
+            held.erase(it);
+            notify = waiters != 0; // a writer may be waiting for the last reader
+        }
+    }
+
+    if (notify) {
+        cv.notify_all();
+    }
+}
+
+cfs::filesystem::filesystem(const std::string &path_to_block_file, const bool read_only) : static_info_({})
 {
     global_control_flags.store({});
-    file_.open(path_to_block_file);
+    file_.open(path_to_block_file, read_only);
     if (file_.size() < sizeof(cfs_head_t)) {
         throw error::cannot_even_read_cfs_header_in_that_small_tiny_file();
     }
@@ -481,7 +549,6 @@ cfs::filesystem::filesystem(const std::string &path_to_block_file) : static_info
     cfs_header_block.fs_head = header_temp;
     cfs_header_block.fs_end = header_temp_tail;
     *const_cast<uint64_t *>(&bitlocker_.blocks_) = static_info_.blocks;
-    bitlocker_.init();
 
     decltype(cfs_head_t::runtime_info_t::flags) flags = { .clean = 0 };
     static_assert(sizeof(flags) == sizeof(uint64_t));
@@ -497,6 +564,22 @@ cfs::filesystem::guard cfs::filesystem::lock(const uint64_t index)
         index, static_info_.block_size };
 }
 
+cfs::filesystem::guard_continuous cfs::filesystem::lock_continuous(const uint64_t start, const uint64_t count, const bool shared)
+{
+    cfs_assert_simple(count != 0 && start < static_info_.blocks && count <= static_info_.blocks - start);
+    return { &this->bitlocker_,
+        this->file_.data() + start * static_info_.block_size,
+        start, count, static_info_.block_size, shared };
+}
+
+cfs::filesystem::shared_guard cfs::filesystem::lock_shared(const uint64_t index)
+{
+    cfs_assert_simple(index < static_info_.blocks);
+    return { &this->bitlocker_,
+        this->file_.data() + index * static_info_.block_size,
+        index, static_info_.block_size };
+}
+
 cfs::filesystem::~filesystem() noexcept
 {
     try {
@@ -19,20 +19,52 @@ namespace cfs
         cfs_journaling_t journaling_;
         cfs_bitmap_block_mirroring_t mirrored_bitmap_;
         cfs_block_attribute_access_t block_attribute_;
+        const cfs_journal_replay_t::report_t replay_report_; /// replay runs before the reclaimer looks for garbage
         cfs_block_manager_t block_manager_;
 
     public:
-        void set_nocow() { cfs_basic_filesystem_.global_control_flags.store({ .no_pointer_and_storage_cow = 1 }); }
+        void set_nocow()
+        {
+            auto flags = cfs_basic_filesystem_.global_control_flags.load();
+            flags.no_pointer_and_storage_cow = 1;
+            cfs_basic_filesystem_.global_control_flags.store(flags);
+        }
+
+        /// modify blocks that no snapshot can see in place, only frozen blocks are CoW'd
+        void set_overwrite_exclusive()
+        {
+            auto flags = cfs_basic_filesystem_.global_control_flags.load();
+            flags.overwrite_exclusive_blocks = 1;
+            cfs_basic_filesystem_.global_control_flags.store(flags);
+        }
+
+        /// set transaction group timeout, transaction groups are off until this is called
+        /// @param seconds Commit transaction group after this many seconds, 0 means CoW up to root on every change
+        void set_transaction_group_timeout(const uint64_t seconds) { block_manager_.transaction_group().set_mode(seconds); }
+
+        /// set redundancy retention watermark
+        /// @param percent CoW redundancies are reclaimed in background once free blocks drop below this percentage
+        void set_reclaim_watermark(const uint64_t percent) { block_manager_.reclaimer().set_watermark(percent); }
+
+        /// start/stop background redundancy reclaim, start after FUSE forked into background since threads don't survive that
+        void start_background_reclaim() { block_manager_.reclaimer().start(); }
+        void stop_background_reclaim() { block_manager_.reclaimer().stop(); }
 
         explicit CowFileSystem(const std::string & path) :
             cfs_basic_filesystem_(path),
             journaling_(&cfs_basic_filesystem_),
             mirrored_bitmap_(&cfs_basic_filesystem_, &journaling_),
             block_attribute_(&cfs_basic_filesystem_, &journaling_),
+            replay_report_(cfs_journal_replay_t(&cfs_basic_filesystem_, &journaling_, &mirrored_bitmap_, &block_attribute_).replay(true)),
             block_manager_(&mirrored_bitmap_, &cfs_basic_filesystem_.cfs_header_block, &block_attribute_, &journaling_)
-        { }
+        {
+            report_replay();
+        }
 
     private:
+        /// log what mount time journal replay found
+        void report_replay();
+
         /// wrapper for ls_pwd
         std::vector <std::string> ls_under_pwd_of_cfs(const std::string & /* type is always cfs */);
 
@@ -57,6 +89,7 @@ namespace cfs
         void copy(const std::vector<std::string> &vec);
         void move(const std::vector<std::string> &vec);
         void cat(const std::vector<std::string> &vec);
+        void nocow(const std::vector<std::string> &vec);
 
         /// turn path into vector
         static std::vector<std::string> path_to_vector(const std::string & path) noexcept;
@@ -142,6 +175,12 @@ namespace cfs
         /// @return 0 means good, negative + errno means error
         int do_chmod(const std::string &  path, mode_t mode) noexcept;
 
+        /// change CFS inode flags
+        /// @param path Full path
+        /// @param flags inode_flag_*
+        /// @return 0 means good, negative + errno means error
+        int do_chflags(const std::string & path, uint32_t flags) noexcept;
+
         /// Create a non-dir file inode
         /// @param path Full path
         /// @param mode permissions
@@ -198,17 +237,17 @@ namespace cfs
         /// @return 0 means good, negative + errno means error
         int do_rmdir(const std::string & path) noexcept;
 
-        /// Sync filesystem
+        /// Commit current transaction group and sync filesystem
         /// @return 0 means good, negative + errno means error
-        int do_fsync(const std::string &, int) noexcept { return do_flush(); }
+        int do_fsync(const std::string &, int) noexcept;
 
         /// wrapped to sync
         /// @return 0 means good, negative + errno means error
         int do_releasedir(const std::string & ) noexcept { return do_flush(); }
 
-        /// wrapped to sync
+        /// wrapped to fsync
         /// @return 0 means good, negative + errno means error
-        int do_fsyncdir(const std::string &, int) noexcept { return do_flush(); }
+        int do_fsyncdir(const std::string & path, const int datasync) noexcept { return do_fsync(path, datasync); }
 
         /// Resize a file
         /// @param path Full path
@@ -11,7 +11,7 @@ namespace cfs
         dev_t       st_dev;         /* ID of device containing file */
         ino_t       st_ino;         /* Inode number */
         mode_t      st_mode;        /* File type and mode */
-        char _reserved_[4];
+        uint32_t    st_flags;       /* CFS inode flags, inode_flag_* */
         nlink_t     st_nlink;       /* Number of hard links */
         uid_t       st_uid;         /* User ID of owner */
         gid_t       st_gid;         /* Group ID of owner */
@@ -26,6 +26,9 @@ namespace cfs
     constexpr uint64_t stat_size = 120;
     static_assert(sizeof(stat) == stat_size);
 
+    constexpr uint32_t inode_flag_nocow = 0x01; // overwrite blocks in place unless a snapshot can see them
+    constexpr uint32_t inode_flags_inherited = inode_flag_nocow; // flags new inodes inherit from their directory
+
     constexpr uint64_t cfs_magick_number = 0xCFADBEEF20251216;
     constexpr uint64_t cfs_magic_number_compliment = ~cfs_magick_number;
     constexpr uint64_t cfs_header_size = 512;
@@ -119,10 +122,15 @@ namespace cfs
     static_assert(sizeof(cfs_block_attribute_t) == cfs_block_attribute_size, "Faulty attribute size");
 
     constexpr uint64_t cfs_journal_action_size = 64;
+    constexpr uint16_t cfs_journal_record_magic = 0xCFAD;
+    constexpr uint8_t cfs_journal_record_version = 2; // 1 had a 64bit magic and CRC64, without sequence
     struct cfs_action_t
     {
-        uint64_t cfs_magic;
-        uint64_t action_param_crc64;
+        uint16_t cfs_magic;         // cfs_journal_record_magic
+        uint8_t version;            // cfs_journal_record_version
+        uint8_t length;             // record length in bytes, records are parsed by this stride
+        uint32_t record_crc32;      // CRC32C of sequence and action_data
+        uint64_t sequence;          // one up per record across the whole journal lifetime, 0 is never used
         union
         {
             struct action_plain_t
@@ -143,7 +151,7 @@ namespace cfs
         uint64_t head;
         uint64_t tail;
         uint64_t size;
-        uint64_t reserved;
+        uint64_t replayed;  // sequence of the last replay marker, mount reads the journal from there on
     };
     static_assert(sizeof(journal_header_t) == cfs_journal_header_size, "Faulty journal header size");
 
@@ -159,7 +167,12 @@ namespace cfs
 
     FilesystemActionType_Def(AttemptedFixFinishedAndAssumedFine, 0x2020); // [Corruption Type]
 
+    FilesystemActionType_Def(TransactionGroupCommit, 0x2030); // [Transaction Group ID] [Blocks Allocated in Group]
+
+    FilesystemActionType_Def(JournalReplayed, 0x2040); // [Interrupted Transactions] [Rolled Back] [Rolled Forward]
+
     FilesystemActionType_Def(GlobalTransaction, 0x3000) // [Transaction Type], [PARAM...]
+    FilesystemActionType_Def(NestedTransaction, 0x3100) // [Transaction Type], [PARAM...], [Outermost Start Sequence]
 
 #   define GlobalTransaction_Def(x, val) \
     FilesystemActionType_Def(x, val); \
@@ -167,9 +180,13 @@ namespace cfs
     FilesystemActionType_Def(x##_Failed, val + 2);
 
     GlobalTransaction_Def(FilesystemBitmapModification,         0x2010);    // [FROM] [TO] [LOCATION]
+    GlobalTransaction_Def(FilesystemBitmapRangeModification,    0x2013);    // [TO] [START] [COUNT]
     GlobalTransaction_Def(GlobalTransaction_AllocateBlock,      0x3001)
     GlobalTransaction_Def(GlobalTransaction_DeallocateBlock,    0x3004)     // [Where]
     GlobalTransaction_Def(GlobalTransaction_CreateRedundancy,   0x3007)     // [Which] [Where]
+    GlobalTransaction_Def(GlobalTransaction_OverwriteInPlace,   0x3019)     // [Which] [Before-image] [CRC64 of before-image]
+    GlobalTransaction_Def(GlobalTransaction_AllocateRange,      0x301C)     // [Blocks] [Goal]
+    GlobalTransaction_Def(GlobalTransaction_ReclaimRedundancy,  0x301F)     // [Blocks]
 
     // major change, which are write inode, inode metadata modification, or snapshot creation/revert/deletion
     GlobalTransaction_Def(GlobalTransaction_Major_WriteInode,         0x300A)     // [Which inode] [Offset] [Size]
@@ -177,6 +194,7 @@ namespace cfs
     GlobalTransaction_Def(GlobalTransaction_Major_SnapshotCreation,   0x3010)
     GlobalTransaction_Def(GlobalTransaction_Major_SnapshotRevert,     0x3013)     // [Version Entry Point]
     GlobalTransaction_Def(GlobalTransaction_Major_SnapshotDeletion,   0x3016)     // [Version Entry Point]
+    GlobalTransaction_Def(GlobalTransaction_Major_ResizeInode,        0x3022)     // [Which inode] [Size]
     /// CFS inode memory mapper
     class cfs_inode_t {
         char * data_ = nullptr;
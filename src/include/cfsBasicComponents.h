@@ -6,6 +6,18 @@
 #include "smart_block_t.h"
 #include "generalCFSbaseError.h"
 #include "tsl/hopscotch_map.h"
+#include "tsl/hopscotch_set.h"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <thread>
 
 make_simple_error_class(no_more_free_spaces)
 
@@ -72,28 +84,86 @@ namespace cfs
         const uint64_t journal_end_;
         const uint64_t block_size_;
         const uint64_t capacity_ = 0;
+        filesystem::guard_continuous journal_lock_; /// journal region is ours for the whole lifetime
 
         char * journal_raw_buffer_;
         char * journal_body_;
 
         journal_header_t * journal_header_;     // start of the ring
         journal_header_t * journal_header_cow_; // end of the ring
-        std::mutex mutex_;
+        std::mutex mutex_;                      /// ring writes and reads
+
+        /// staging ring. Every action takes the next sequence number and is published into slot sequence % staging_slots
+        /// without any lock. Whichever thread wins committing_ copies the run of published slots after written_
+        /// into the journal, so actions reach the journal in sequence order and a thread whose action
+        /// is written by someone else never blocks on a lock
+        static constexpr uint64_t staging_slots = 256;
+        std::unique_ptr < cfs_action_t[] > staged_;                    /// staged actions
+        std::unique_ptr < std::atomic < uint64_t >[] > staged_sequence_; /// sequence + 1 of the action in the slot, 0 if never used
+        std::atomic < uint64_t > next_sequence_ = 0;                     /// sequence of the next action
+        std::atomic < uint64_t > written_ = 0;                           /// actions before this sequence are in the journal
+        std::atomic_bool committing_ = false;
+
+        /// copy every published action after written_ into the journal, committing_ held
+        void drain_staged();
+
+        /// copy data into the ring at head, wraps around with at most two copies.
+        /// When the ring is full, the oldest data is discarded. Head is placed right after the newest
+        /// record on mount, so a journal header that lagged behind the records does not matter
+        /// @param data Data
+        /// @param length Data length in bytes
+        void write(const void * data, uint64_t length);
+
+        /// record in the given physical slot of the ring
+        [[nodiscard]] const cfs_action_t * record_at(const uint64_t slot) const {
+            return reinterpret_cast<const cfs_action_t *>(journal_body_ + slot * sizeof(cfs_action_t));
+        }
+
+        /// sequence of the record in the given physical slot of the ring
+        /// @return Sequence, 0 if the slot holds no valid record
+        [[nodiscard]] uint64_t sequence_at(uint64_t slot) const;
 
-        /// put a 8bit data into the journal
-        /// @param c 8bit data
-        void putc(char c);
+        /// first physical slot holding a valid record
+        /// @param slot Slot to start from
+        /// @param end Slot to stop at
+        /// @return Slot, end if none of them holds a valid record
+        [[nodiscard]] uint64_t valid_slot_from(uint64_t slot, uint64_t end) const;
 
-        /// dump all journal data
-        [[nodiscard]] std::vector<uint8_t> dump() const;
+        /// physical slot of the newest record, found by a binary search on sequence over the ring itself
+        /// @return [slot, sequence], sequence is 0 if the journal holds no valid record
+        [[nodiscard]] std::pair < uint64_t, uint64_t > newest_slot() const;
 
     public:
         explicit cfs_journaling_t(cfs::filesystem * parent_fs_governor);
-        ~cfs_journaling_t();
+
+        /// check record header and CRC
+        /// @param action Journal record
+        /// @return true if the record is intact
+        [[nodiscard]] static bool valid(const cfs_action_t & action);
+
+        /// newest record of the ring, found by a binary search on sequence over the ring itself
+        /// so that a stale journal header does not matter
+        /// @return Sequence of the newest record, 0 if the journal holds none
+        [[nodiscard]] uint64_t newest_sequence();
+
+        /// visit intact records from the given sequence on, oldest first, read in place without copying the ring.
+        /// The start is found by a binary search on sequence, journal writes wait until the visit is done
+        /// @param from_sequence First sequence to visit, 0 visits the whole journal
+        /// @param visit Invoked with every record
+        template < typename Func >
+        void for_each_action(uint64_t from_sequence, Func && visit);
 
         /// dump all journal actions
         [[nodiscard]] std::vector < cfs_action_t > dump_actions();
 
+        /// sequence of the last replay marker
+        /// @return Sequence, 0 if the journal was never replayed
+        [[nodiscard]] uint64_t replayed_sequence();
+
+        /// remember the replay marker, the next replay starts right after it
+        /// @param sequence Sequence of the replay marker
+        void set_replayed_sequence(uint64_t sequence);
+
         /// push an action into the journal
         /// @param action Filesystem action
         /// @param action_param0 Action parameter 0
@@ -101,7 +171,8 @@ namespace cfs
         /// @param action_param2 Action parameter 2
         /// @param action_param3 Action parameter 3
         /// @param action_param4 Action parameter 4
-        void push_action(
+        /// @return Sequence of the action
+        uint64_t push_action(
             uint64_t action,
             uint64_t action_param0 = 0,
             uint64_t action_param1 = 0,
@@ -112,6 +183,44 @@ namespace cfs
         NO_COPY_OBJ(cfs_journaling_t);
     };
 
+    template < typename Func >
+    void cfs_journaling_t::for_each_action(const uint64_t from_sequence, Func && visit)
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        const uint64_t slots = capacity_ / sizeof(cfs_action_t);
+        const uint64_t tail = journal_header_->tail / sizeof(cfs_action_t);
+        const uint64_t count = journal_header_->size / sizeof(cfs_action_t);
+        auto logical = [&](const uint64_t i) { return record_at((tail + i) % slots); };
+
+        // sequences grow from tail to head, find the first one not older than from_sequence.
+        // a slot without a valid record (torn, or left by an older format) has no sequence to compare,
+        // the nearest valid record after it stands in for it
+        uint64_t begin = 0, end = count;
+        while (begin < end)
+        {
+            const uint64_t middle = begin + (end - begin) / 2;
+            uint64_t probe = middle;
+            while (probe < end && !valid(*logical(probe))) {
+                probe++;
+            }
+
+            if (probe == end) {
+                end = middle; // nothing valid up to end
+            } else if (logical(probe)->sequence < from_sequence) {
+                begin = probe + 1;
+            } else {
+                end = middle;
+            }
+        }
+
+        for (uint64_t i = begin; i < count; i++)
+        {
+            if (const auto * action = logical(i); valid(*action)) {
+                visit(*action);
+            }
+        }
+    }
+
     class cfs_bitmap_singular_t : public bitmap_base
     {
     public:
@@ -124,18 +233,56 @@ namespace cfs
         // [[nodiscard]] uint64_t dump_checksum64();
     };
 
+    /// Block bitmap. mirror1 is the only bitmap read and written at runtime, every page of it carries a checksum
+    /// kept in step with each bit flip. mirror2 is brought up to mirror1 at commit(), and only read back
+    /// when a page of mirror1 no longer matches its checksum. Checksums are not stored on disk, so on mount
+    /// the two mirrors are compared instead, and pages that differ are merged before anything trusts them.
+    /// Bit flips aren't journaled, the block manager journals the runs it claims instead
     class cfs_bitmap_block_mirroring_t
     {
         cfs_bitmap_singular_t mirror1;
         cfs_bitmap_singular_t mirror2;
         cfs::filesystem * parent_fs_governor_;
         cfs_journaling_t * journal_;
-        std::mutex dump_mutex_;
+        std::mutex dump_mutex_; /// serializes dumps and commits, bit flips only take their bitmap page lock
+        uint64_t pages_ = 0;    /// bitmap pages
+        std::unique_ptr < std::atomic_bool[] > dirty_pages_; /// pages changed since last dump_dirty_pages()
+        std::unique_ptr < std::atomic_bool[] > uncommitted_pages_; /// pages changed since last commit()
+        std::atomic < uint64_t > last_commit_ = 0; /// timestamp of last commit()
+
+        /// free space summary. page counts change under the page lock, the rest is atomic
+        std::vector < uint32_t > page_free_bits_;                        /// cleared bits in every bitmap page
+        std::unique_ptr < std::atomic < uint64_t >[] > pages_with_free_bits_; /// bit n is set when page n has cleared bits
+        std::atomic < uint64_t > free_bits_ = 0;                         /// cleared bits in the whole map
+
+        /// checksum of every page of mirror1, changes under the page lock
+        std::vector < uint64_t > page_checksums_;
+
+        /// set bit with its page lock held
+        void set_bit_unblocked(uint64_t index, bool original, bool new_bit);
+
+        /// keep the summary and the page checksum in step with one bit flip, page lock held
+        void update_summary(uint64_t page, uint64_t index, bool new_bit);
+
+        /// count cleared bits and checksum one page of mirror1, page lock held
+        /// @return [cleared bits, checksum]
+        [[nodiscard]] std::pair < uint32_t, uint64_t > scan_page(uint64_t page) const;
+
+        /// merge pages where the mirrors differ, then count cleared bits and checksum every page, done once on mount
+        void rebuild_summary();
+
+        /// first page at or after the given one that has cleared bits
+        /// @param page Bitmap page index
+        /// @return Page index, or page count if no page after that has cleared bits
+        [[nodiscard]] uint64_t next_page_with_free_bits(uint64_t page) const;
 
     public:
         explicit cfs_bitmap_block_mirroring_t(cfs::filesystem * parent_fs_governor, cfs_journaling_t * journal);
 
-        /// Get bit at the specific location
+        ~cfs_bitmap_block_mirroring_t() { commit(); }
+        NO_COPY_OBJ(cfs_bitmap_block_mirroring_t)
+
+        /// Get bit at the specific location, a single atomic read without any lock
         /// @param index Bit Index
         /// @return The bit at the specific location
         /// @throws cfs::error::assertion_failed Out of bounds
@@ -148,14 +295,54 @@ namespace cfs
         /// @throws cfs::error::assertion_failed Out of bounds
         void set_bit(uint64_t index, bool new_bit);
 
-        std::vector<uint8_t> dump()
-        {
-            std::lock_guard lock(dump_mutex_);
-            std::vector<uint8_t> ret;
-            ret.resize(mirror1.size());
-            std::memcpy(ret.data(), mirror1.data(), mirror1.size());
-            return ret;
-        }
+        /// Set the bit at the specific location only if it is currently cleared
+        /// @param index Bit Index
+        /// @return true if the bit was cleared and is now set by this call, false if it was already set
+        /// @throws cfs::error::assertion_failed Out of bounds
+        bool test_and_set_bit(uint64_t index);
+
+        /// Set a run of cleared bits starting at the specific location, stops at the first set bit or the page end
+        /// @param start First bit of the run
+        /// @param max_count Longest run to claim
+        /// @return Bits claimed, 0 if start is already set
+        /// @throws cfs::error::assertion_failed Out of bounds
+        uint64_t claim_range(uint64_t start, uint64_t max_count);
+
+        /// Find the first cleared bit in [start, end), 64 bits at a time.
+        /// Each bitmap page is locked (shared) once, instead of once per bit
+        /// @param start Bit index to start from
+        /// @param end Bit index to stop at (exclusive)
+        /// @return Index of the first cleared bit, or end if every bit in range is set
+        /// @throws cfs::error::assertion_failed Out of bounds
+        uint64_t find_first_zero(uint64_t start, uint64_t end);
+
+        /// Copy pages changed since last commit to mirror2, checksum checked first. A page that fails it is
+        /// merged with mirror2 instead, keeping every bit set in either, like pages that differ on mount
+        /// @return Pages merged with mirror2
+        uint64_t commit();
+
+        static constexpr uint64_t commit_interval = 5; /// seconds between commits of commit_periodically()
+
+        /// commit() unless the last commit is less than commit_interval seconds ago, so callers as frequent as
+        /// root CoW share one pass over the changed pages. A mirror left behind is merged on mount
+        void commit_periodically();
+
+        /// Cleared bits in the whole map, kept by the free space summary
+        [[nodiscard]] uint64_t free_bits() const { return free_bits_; }
+
+        /// Dump the whole bitmap
+        std::vector<uint8_t> dump();
+
+        /// Bitmap pages
+        [[nodiscard]] uint64_t pages() const { return pages_; }
+
+        using dirty_pages_t = std::vector < std::pair < uint64_t, std::vector<uint8_t> > >; /// [page index, page data]
+
+        /// Dump bitmap pages changed since last call, and start tracking from scratch.
+        /// Every page counts as changed right after mount
+        /// @param all Dump every page, changed or not
+        /// @return [page index, page data], sorted by page index. Page size is block size, last page can be shorter
+        dirty_pages_t dump_dirty_pages(bool all = false);
     };
     
     class block_status { };    // => BlockStatusType
@@ -165,15 +352,52 @@ namespace cfs
     class index_node_referencing_number { }; // Max 0xFFFF (65535) depth of snapshots
     class block_checksum { };
 
+    /// Block attribute table. Every entry is one aligned 32bit word in the mapped table, so reads are atomic loads
+    /// and changes are compare-and-swap loops on it, no lock is taken
     class cfs_block_attribute_access_t {
         filesystem * parent_fs_governor_;
         cfs_journaling_t * journal_;
-        cfs::filesystem::block_shared_lock_t location_lock_;
+        uint32_t * table_ = nullptr; /// attribute table in the mapped file
+        const uint64_t blocks_ = 0;
+        std::function < void(uint64_t) > reclaimable_hook_; /// see set_reclaimable_hook()
         // std::atomic_bool dirty_ = false;
 
+        static_assert(sizeof(cfs_block_attribute_t) == sizeof(uint32_t));
+
+        /// entry of a block
+        [[nodiscard]] std::atomic_ref < uint32_t > entry(const uint64_t index) const
+        {
+            cfs_assert_simple(index < blocks_);
+            return std::atomic_ref < uint32_t > (table_[index]);
+        }
+
+        /// field of an attribute selected by tag type
+        template < typename Type >
+        static uint32_t field(const cfs_block_attribute_t & attr);
+
+        /// set field of an attribute selected by tag type
+        template < typename Type >
+        static void field(cfs_block_attribute_t & attr, uint32_t value);
+
+        /// apply a change to the attribute of a block atomically. the change is retried on a copy of the latest value
+        /// until no other writer got in between, so it must not have side effects
+        /// @param index Block index
+        /// @param change Invoked with the attribute to change
+        /// @return [before, after]
+        template < typename Func >
+        std::pair < cfs_block_attribute_t, cfs_block_attribute_t > update(uint64_t index, Func && change);
+
+        /// header counter and reclaimable hook for a change that already happened
+        void after_change(uint64_t index, const cfs_block_attribute_t & before, const cfs_block_attribute_t & after);
+
     public:
         // bool dirty() { return dirty_; }
 
+        /// install a callback invoked right after a block turns into a CoW redundancy or loses its last reference.
+        /// Install before any concurrent access, nullptr removes it
+        /// @param hook Callback receiving the block index
+        void set_reclaimable_hook(std::function < void(uint64_t) > hook) { reclaimable_hook_ = std::move(hook); }
+
         std::vector<uint8_t> dump()
         {
             const uint64_t map_len = parent_fs_governor_->static_info_.data_table_end - parent_fs_governor_->static_info_.data_table_start;
@@ -192,31 +416,12 @@ namespace cfs
 
         explicit cfs_block_attribute_access_t(filesystem * parent_fs_governor, cfs_journaling_t * journal);
 
-        class smart_lock_t {
-            cfs_block_attribute_t before_ { };
-            cfs_block_attribute_access_t * parent_;
-
-        public:
-            cfs_block_attribute_t * data_;
-            cfs_block_attribute_t * operator->() const { return data_; }
-            cfs_block_attribute_t & operator*() const { return *data_; }
-
-        private:
-            const uint64_t index_;
-            explicit smart_lock_t(cfs_block_attribute_access_t * parent, uint64_t index);
-
-        public:
-            ~smart_lock_t();
-
-            friend class cfs_block_attribute_access_t;
-            NO_COPY_OBJ(smart_lock_t)
-        };
-
-    protected:
-        [[nodiscard]] smart_lock_t lock(const uint64_t index) { return smart_lock_t(this, index); }
+        /// blocks covered by the table
+        [[nodiscard]] uint64_t blocks() const { return blocks_; }
 
-    public:
-        cfs_block_attribute_t get(const uint64_t index) { return *lock(index); }
+        cfs_block_attribute_t get(const uint64_t index) const {
+            return std::bit_cast<cfs_block_attribute_t>(entry(index).load(std::memory_order_acquire));
+        }
 
         template < typename Type >
         requires (std::is_same_v<Type, block_status>
@@ -225,7 +430,7 @@ namespace cfs
             || std::is_same_v<Type, allocation_oom_scan_per_refresh_count>
             || std::is_same_v<Type, index_node_referencing_number>
             || std::is_same_v<Type, block_checksum>)
-        uint32_t get(uint64_t index);
+        uint32_t get(const uint64_t index) const { return field<Type>(get(index)); }
 
         template < typename Type >
         requires (std::is_same_v<Type, block_status>
@@ -254,7 +459,10 @@ namespace cfs
             || std::is_same_v<Type2, allocation_oom_scan_per_refresh_count>
             || std::is_same_v<Type2, index_node_referencing_number>
             || std::is_same_v<Type2, block_checksum>)
-        void move(uint64_t index);
+        void move(const uint64_t index) {
+            const auto [before, after] = update(index, [](cfs_block_attribute_t & attr) { field<Type2>(attr, field<Type1>(attr)); });
+            after_change(index, before, after);
+        }
 
         template < typename Type >
         requires (std::is_same_v<Type, allocation_oom_scan_per_refresh_count>
@@ -266,40 +474,110 @@ namespace cfs
             || std::is_same_v<Type, index_node_referencing_number>)
         void dec(uint64_t index, uint32_t value = 1);
 
-        void clear(const uint64_t index, const cfs_block_attribute_t & value = { })
+        void clear(const uint64_t index, const cfs_block_attribute_t & value = { }) {
+            entry(index).store(std::bit_cast<uint32_t>(value), std::memory_order_release);
+        }
+
+        // Full-table passes. They take a bitmap (dump of the block bitmap, or any map of the same layout) and only
+        // visit blocks set in it, 64 blocks per bitmap word, empty words are skipped without touching the table
+
+        /// call visit for every block set in bitmap
+        /// @param bitmap One bit per block, LSB first
+        /// @param visit Invoked with block index and its attribute, in block order
+        template < typename Func >
+        void for_each_set(const std::vector < uint8_t > & bitmap, Func && visit) const;
+
+        /// count blocks set in bitmap whose attribute satisfies pred
+        /// @return Block count
+        template < typename Pred >
+        [[nodiscard]] uint64_t count_if(const std::vector < uint8_t > & bitmap, Pred && pred) const
         {
-            const auto lock_ = lock(index);
-            *lock_ = value;
+            uint64_t count = 0;
+            for_each_set(bitmap, [&](uint64_t, const cfs_block_attribute_t & attr) { count += pred(attr) ? 1 : 0; });
+            return count;
+        }
+
+        /// clear bits in bitmap whose block attribute satisfies pred
+        /// @return Bits cleared
+        template < typename Pred >
+        uint64_t remove_if(std::vector < uint8_t > & bitmap, Pred && pred) const
+        {
+            uint64_t count = 0;
+            for_each_set(bitmap, [&](const uint64_t index, const cfs_block_attribute_t & attr)
+            {
+                if (pred(attr)) {
+                    bitmap[index / 8] &= static_cast<uint8_t>(~(1u << (index % 8)));
+                    count++;
+                }
+            });
+            return count;
+        }
+
+        /// apply change to the attribute of every block set in bitmap, entries the change leaves as they are aren't written
+        /// @param change Invoked with the attribute to change, same rules as update()
+        /// @return Blocks changed
+        template < typename Func >
+        uint64_t update_each(const std::vector < uint8_t > & bitmap, Func && change)
+        {
+            uint64_t count = 0;
+            for_each_set(bitmap, [&](const uint64_t index, cfs_block_attribute_t attr)
+            {
+                const auto before = std::bit_cast<uint32_t>(attr);
+                change(attr);
+                if (std::bit_cast<uint32_t>(attr) != before)
+                {
+                    const auto [old_value, new_value] = update(index, change);
+                    after_change(index, old_value, new_value);
+                    count++;
+                }
+            });
+            return count;
         }
-        friend class smart_lock_t;
     };
 
-    template<typename Type>
-    requires (std::is_same_v<Type, block_status>
-        || std::is_same_v<Type, block_type>
-        || std::is_same_v<Type, block_type_cow>
-        || std::is_same_v<Type, allocation_oom_scan_per_refresh_count>
-        || std::is_same_v<Type, index_node_referencing_number>
-        || std::is_same_v<Type, block_checksum>)
-    uint32_t cfs_block_attribute_access_t::get(const uint64_t index)
+    template < typename Func >
+    void cfs_block_attribute_access_t::for_each_set(const std::vector < uint8_t > & bitmap, Func && visit) const
+    {
+        // bits are LSB first in every byte, so on a little endian host a 64bit load puts bit n of the word at block word * 64 + n
+        static_assert(std::endian::native == std::endian::little, "word scan assumes a little endian host");
+        const uint64_t bytes = std::min<uint64_t>(bitmap.size(), (blocks_ + 7) / 8);
+        for (uint64_t offset = 0; offset < bytes; offset += sizeof(uint64_t))
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, bitmap.data() + offset, std::min<uint64_t>(sizeof(uint64_t), bytes - offset));
+            for (; word != 0; word &= word - 1)
+            {
+                const uint64_t index = offset * 8 + std::countr_zero(word);
+                if (index >= blocks_) {
+                    return; // padding
+                }
+
+                visit(index, std::bit_cast<cfs_block_attribute_t>(
+                    std::atomic_ref<uint32_t>(table_[index]).load(std::memory_order_acquire)));
+            }
+        }
+    }
+
+    template < typename Type >
+    uint32_t cfs_block_attribute_access_t::field(const cfs_block_attribute_t & attr)
     {
         if constexpr (std::is_same_v<Type, block_status>) {
-            return lock(index)->block_status;
+            return attr.block_status;
         }
         else if constexpr (std::is_same_v<Type, block_type>) {
-            return lock(index)->block_type;
+            return attr.block_type;
         }
         else if constexpr (std::is_same_v<Type, block_type_cow>) {
-            return lock(index)->block_type_cow;
+            return attr.block_type_cow;
         }
         else if constexpr (std::is_same_v<Type, allocation_oom_scan_per_refresh_count>) {
-            return lock(index)->allocation_oom_scan_per_refresh_count;
+            return attr.allocation_oom_scan_per_refresh_count;
         }
         else if constexpr (std::is_same_v<Type, index_node_referencing_number>) {
-            return lock(index)->index_node_referencing_number;
+            return attr.index_node_referencing_number;
         }
         else if constexpr (std::is_same_v<Type, block_checksum>) {
-            return lock(index)->block_checksum;
+            return attr.block_checksum;
         }
         else {
             // already guarded in requires
@@ -307,113 +585,60 @@ namespace cfs
         }
     }
 
-    template<typename Type>
-    requires (std::is_same_v<Type, block_status>
-    || std::is_same_v<Type, block_type>
-    || std::is_same_v<Type, block_type_cow>
-    || std::is_same_v<Type, allocation_oom_scan_per_refresh_count>
-    || std::is_same_v<Type, index_node_referencing_number>
-    || std::is_same_v<Type, block_checksum>)
-    void cfs_block_attribute_access_t::set(const uint64_t index, const uint32_t value)
+    template < typename Type >
+    void cfs_block_attribute_access_t::field(cfs_block_attribute_t & attr, const uint32_t value)
     {
-        auto lock_ = lock(index);
-        // if (!lock_->newly_allocated_thus_no_cow) {
-            // dirty_ = true;
-        // }
-
         if constexpr (std::is_same_v<Type, block_status>) {
-            lock_->block_status = value;
+            attr.block_status = value;
         }
         else if constexpr (std::is_same_v<Type, block_type>) {
-            if (value == COW_REDUNDANCY_BLOCK && lock_->block_type != COW_REDUNDANCY_BLOCK) {
-                this->parent_fs_governor_->cfs_header_block.dec<allocated_non_cow_blocks>();
-            } else if (value != COW_REDUNDANCY_BLOCK && lock_->block_type == COW_REDUNDANCY_BLOCK) {
-                this->parent_fs_governor_->cfs_header_block.inc<allocated_non_cow_blocks>();
-            }
-
-            lock_->block_type = value;
+            attr.block_type = value;
         }
         else if constexpr (std::is_same_v<Type, block_type_cow>) {
-            lock_->block_type_cow = value;
+            attr.block_type_cow = value;
         }
         else if constexpr (std::is_same_v<Type, allocation_oom_scan_per_refresh_count>) {
-            lock_->allocation_oom_scan_per_refresh_count = value;
+            attr.allocation_oom_scan_per_refresh_count = value;
         }
         else if constexpr (std::is_same_v<Type, index_node_referencing_number>) {
-            lock_->index_node_referencing_number = value;
+            attr.index_node_referencing_number = value;
         }
         else if constexpr (std::is_same_v<Type, block_checksum>) {
-            lock_->block_checksum = value;
+            attr.block_checksum = value;
         }
         else {
             // already guarded in requires
         }
     }
 
-    template<typename Type1, typename Type2>
-    requires (
-       std::is_same_v<Type1, block_status>
-    || std::is_same_v<Type1, block_type>
-    || std::is_same_v<Type1, block_type_cow>
-    || std::is_same_v<Type1, allocation_oom_scan_per_refresh_count>
-    || std::is_same_v<Type1, index_node_referencing_number>
-    || std::is_same_v<Type1, block_checksum>
-    || std::is_same_v<Type2, block_status>
-    || std::is_same_v<Type2, block_type>
-    || std::is_same_v<Type2, block_type_cow>
-    || std::is_same_v<Type2, allocation_oom_scan_per_refresh_count>
-    || std::is_same_v<Type2, index_node_referencing_number>
-    || std::is_same_v<Type2, block_checksum>)
-    void cfs_block_attribute_access_t::move(const uint64_t index)
+    template < typename Func >
+    std::pair < cfs_block_attribute_t, cfs_block_attribute_t >
+    cfs_block_attribute_access_t::update(const uint64_t index, Func && change)
     {
-        auto lock_ = lock(index);
-        // if (!lock_->newly_allocated_thus_no_cow) {
-            // dirty_ = true;
-        // }
-        uint32_t val{};
-        if constexpr (std::is_same_v<Type1, block_status>) {
-            val = lock_->block_status;
-        }
-        else if constexpr (std::is_same_v<Type1, block_type>) {
-            val = lock_->block_type;
-        }
-        else if constexpr (std::is_same_v<Type1, block_type_cow>) {
-            val = lock_->block_type_cow;
-        }
-        else if constexpr (std::is_same_v<Type1, allocation_oom_scan_per_refresh_count>) {
-            val = lock_->allocation_oom_scan_per_refresh_count;
-        }
-        else if constexpr (std::is_same_v<Type1, index_node_referencing_number>) {
-            val = lock_->index_node_referencing_number;
-        }
-        else if constexpr (std::is_same_v<Type1, block_checksum>) {
-            val = lock_->block_checksum;
-        }
-        else {
-            // already guarded in requires
-        }
+        auto ref = entry(index);
+        uint32_t expected = ref.load(std::memory_order_acquire);
+        cfs_block_attribute_t before { }, after { };
+        do {
+            before = std::bit_cast<cfs_block_attribute_t>(expected);
+            after = before;
+            change(after);
+        } while (!ref.compare_exchange_weak(expected, std::bit_cast<uint32_t>(after),
+            std::memory_order_acq_rel, std::memory_order_acquire));
+
+        return { before, after };
+    }
 
-        if constexpr (std::is_same_v<Type2, block_status>) {
-            lock_->block_status = val ;
-        }
-        else if constexpr (std::is_same_v<Type2, block_type>) {
-            lock_->block_type = val ;
-        }
-        else if constexpr (std::is_same_v<Type2, block_type_cow>) {
-            lock_->block_type_cow = val ;
-        }
-        else if constexpr (std::is_same_v<Type2, allocation_oom_scan_per_refresh_count>) {
-            lock_->allocation_oom_scan_per_refresh_count = val ;
-        }
-        else if constexpr (std::is_same_v<Type2, index_node_referencing_number>) {
-            lock_->index_node_referencing_number = val ;
-        }
-        else if constexpr (std::is_same_v<Type2, block_checksum>) {
-            lock_->block_checksum = val ;
-        }
-        else {
-            // already guarded in requires
-        }
+    template<typename Type>
+    requires (std::is_same_v<Type, block_status>
+            || std::is_same_v<Type, block_type>
+            || std::is_same_v<Type, block_type_cow>
+            || std::is_same_v<Type, allocation_oom_scan_per_refresh_count>
+            || std::is_same_v<Type, index_node_referencing_number>
+            || std::is_same_v<Type, block_checksum>)
+    void cfs_block_attribute_access_t::set(const uint64_t index, const uint32_t value)
+    {
+        const auto [before, after] = update(index, [value](cfs_block_attribute_t & attr) { field<Type>(attr, value); });
+        after_change(index, before, after);
     }
 
     template<typename Type>
@@ -421,19 +646,21 @@ namespace cfs
         || std::is_same_v<Type, index_node_referencing_number>)
     void cfs_block_attribute_access_t::inc(const uint64_t index, const uint32_t value)
     {
-        const auto lock_ = lock(index);
-        if constexpr (std::is_same_v<Type, allocation_oom_scan_per_refresh_count>) {
-            if ((lock_->allocation_oom_scan_per_refresh_count + value) <= 0xF) { // only 4 bits
-                lock_->allocation_oom_scan_per_refresh_count += value;
+        update(index, [value](cfs_block_attribute_t & attr)
+        {
+            if constexpr (std::is_same_v<Type, allocation_oom_scan_per_refresh_count>) {
+                if ((attr.allocation_oom_scan_per_refresh_count + value) <= 0xF) { // only 4 bits
+                    attr.allocation_oom_scan_per_refresh_count += value;
+                }
             }
-        }
-        else if constexpr (std::is_same_v<Type, index_node_referencing_number>) {
-            cfs_assert_simple((lock_->index_node_referencing_number + value) < 0x1FFFF); // 17 bits
-            lock_->index_node_referencing_number += value;
-        }
-        else {
-            // already guarded in requires
-        }
+            else if constexpr (std::is_same_v<Type, index_node_referencing_number>) {
+                cfs_assert_simple((attr.index_node_referencing_number + value) < 0x1FFFF); // 17 bits
+                attr.index_node_referencing_number += value;
+            }
+            else {
+                // already guarded in requires
+            }
+        });
     }
 
     template<typename Type>
@@ -441,26 +668,38 @@ namespace cfs
         || std::is_same_v<Type, index_node_referencing_number>)
     void cfs_block_attribute_access_t::dec(const uint64_t index, const uint32_t value)
     {
-        const auto lock_ = lock(index);
-        if constexpr (std::is_same_v<Type, allocation_oom_scan_per_refresh_count>) {
-            if (lock_->allocation_oom_scan_per_refresh_count >= value) {
-                lock_->allocation_oom_scan_per_refresh_count -= value;
+        const auto [before, after] = update(index, [value](cfs_block_attribute_t & attr)
+        {
+            if constexpr (std::is_same_v<Type, allocation_oom_scan_per_refresh_count>) {
+                if (attr.allocation_oom_scan_per_refresh_count >= value) {
+                    attr.allocation_oom_scan_per_refresh_count -= value;
+                }
             }
-        }
-        else if constexpr (std::is_same_v<Type, index_node_referencing_number>) {
-            if (lock_->index_node_referencing_number >= value) {
-                lock_->index_node_referencing_number -= value;
+            else if constexpr (std::is_same_v<Type, index_node_referencing_number>) {
+                if (attr.index_node_referencing_number >= value) {
+                    attr.index_node_referencing_number -= value;
+                }
             }
-        }
-        else {
-            // already guarded in requires
-        }
+            else {
+                // already guarded in requires
+            }
+        });
+        after_change(index, before, after);
     }
 
-    /// auto write to journal so I don't have to
+    /// auto write to journal so I don't have to.
+    /// Only the outermost transaction of a thread writes a start record and one completion or failure record.
+    /// Transactions opened inside it are counted, the count goes into param4 of the closing record. A nested one
+    /// writes a single NestedTransaction record, tagged with the sequence of the outermost start record, when its
+    /// parameters name blocks (bitmap flips, CoW copies, deallocations) so replay can undo them, and when it fails
     class journal_auto_write_t {
         cfs_journaling_t * journal_;
         bool & success_;
+        journal_auto_write_t * previous_; /// innermost open transaction of this thread before this one
+        journal_auto_write_t * parent_;   /// transaction of the same journal this one is nested in, nullptr if outermost
+        uint64_t sub_actions_ = 0;        /// transactions closed inside this one
+        uint64_t outermost_sequence_ = 0; /// sequence of the start record of the outermost transaction
+        static thread_local journal_auto_write_t * current_; /// innermost open transaction of this thread
 
 
         // success
@@ -511,11 +750,303 @@ namespace cfs
         ~journal_auto_write_t();
     };
 
+    /// Mount time journal replay.
+    /// An outermost transaction with a start record but no closing record was cut off by a crash. Those the journal
+    /// describes well enough are rolled back or forward, the rest are reported. Only records after the last replay
+    /// marker are read, so replay costs as much as the tail of the journal, not as much as the device.
+    ///
+    /// Writes and resizes of an inode are resolved block by block: the nested records name every block claimed and
+    /// every CoW copy made, and the inode's pointer tree on disk tells which of them got linked. Unlinked ones are
+    /// given to the reclaimer, originals still linked are restored if they were retired already, and originals
+    /// replaced by a linked copy are retired. Blocks overwritten in place get their before-image back first.
+    /// Limits, left for fsck:
+    ///   - blocks shared with snapshots, as whether their reference count was dropped can't be told
+    ///   - snapshot creation, revert and deletion
+    ///   - work done outside any outermost transaction, such as CoW of an inode block and its dentry
+    class cfs_journal_replay_t
+    {
+        cfs::filesystem * parent_fs_governor_;
+        cfs_journaling_t * journal_;
+        cfs_bitmap_block_mirroring_t * bitmap_;
+        cfs_block_attribute_access_t * block_attribute_;
+
+    public:
+        struct report_t {
+            uint64_t scanned = 0;           /// records read
+            uint64_t interrupted = 0;       /// transactions without closing record
+            uint64_t rolled_back = 0;
+            uint64_t rolled_forward = 0;
+            std::vector < cfs_action_t > unresolved; /// start records of transactions left as they are
+        };
+
+        explicit cfs_journal_replay_t(cfs::filesystem * parent_fs_governor,
+            cfs_journaling_t * journal,
+            cfs_bitmap_block_mirroring_t * bitmap,
+            cfs_block_attribute_access_t * block_attribute)
+            : parent_fs_governor_(parent_fs_governor), journal_(journal), bitmap_(bitmap), block_attribute_(block_attribute) { }
+
+        /// find interrupted transactions and resolve them
+        /// @param apply Roll back/forward and write a replay marker, otherwise only report
+        /// @return What was found and done
+        report_t replay(bool apply);
+
+        NO_COPY_OBJ(cfs_journal_replay_t);
+
+    private:
+        /// roll one interrupted transaction back or forward
+        /// @param start Start record of the transaction
+        /// @param nested NestedTransaction records written inside it
+        /// @param apply Change the filesystem, otherwise only tell what would be done
+        /// @return -1 rolled back, 1 rolled forward, 0 left as it is
+        int resolve(const cfs_action_t & start, const std::vector < cfs_action_t > & nested, bool apply);
+
+        /// pointer and storage blocks the pointer tree of an inode links, read from disk
+        /// @param inode Inode block index
+        /// @return Linked blocks
+        [[nodiscard]] tsl::hopscotch_set < uint64_t > linked_blocks(uint64_t inode) const;
+    };
+
+    /// Inode block map cache, keyed by inode block index.
+    /// inode_t objects are rebuilt along the path on every filesystem call, so the maps live here, next to
+    /// the allocator, and are handed over to whichever inode service locks that inode block next
+    class cfs_block_map_cache_t
+    {
+    public:
+        struct block_map_t {
+            uint64_t st_size = 0; /// inode size this map was built for
+            uint64_t generation = 0; /// generation of the pointer tree this map follows, stamped by put()
+            std::vector < uint64_t > level1_pointers;
+            std::vector < uint64_t > level2_pointers;
+            std::vector < uint64_t > level3_pointers;
+
+            /// how many pointers are held by this map
+            [[nodiscard]] uint64_t pointers() const {
+                return level1_pointers.size() + level2_pointers.size() + level3_pointers.size();
+            }
+        };
+
+        using block_map_ptr_t = std::shared_ptr < block_map_t >;
+
+    private:
+        struct cache_entry_t {
+            block_map_ptr_t map;
+            std::list < uint64_t >::iterator lru_position;
+            uint64_t accounted_pointers;
+            uint64_t generation; /// bumped on every put, a map handed out before is no longer current
+        };
+
+        std::mutex mutex_;
+        std::list < uint64_t > lru_; /// front is the most recently used
+        tsl::hopscotch_map < uint64_t, cache_entry_t > maps_;
+        uint64_t cached_pointers_ = 0;
+        uint64_t next_generation_ = 0;
+        const uint64_t capacity_;
+
+        /// drop least recently used maps until we are under capacity
+        void evict_unblocked();
+
+    public:
+        /// 8M pointers, 64MB of block maps, which is roughly a 32GB file with 4K blocks
+        static constexpr uint64_t default_capacity = 8 * 1024 * 1024;
+
+        /// Create a block map cache
+        /// @param capacity Max pointers held by the cache before least recently used maps are dropped
+        explicit cfs_block_map_cache_t(const uint64_t capacity = default_capacity) : capacity_(capacity) { }
+
+        /// get block map of an inode
+        /// @param inode Inode block index
+        /// @return Cached block map, nullptr if not cached
+        [[nodiscard]] block_map_ptr_t get(uint64_t inode);
+
+        /// put (or refresh) block map of an inode, call again after every change to the pointer tree the map followed.
+        /// stamps the map with a new generation
+        /// @param inode Inode block index
+        /// @param map Block map
+        void put(uint64_t inode, const block_map_ptr_t & map);
+
+        /// check if a map handed out before is still the one cached for an inode, at the same generation
+        /// @param inode Inode block index
+        /// @param map Block map
+        /// @return true if map still follows the pointer tree
+        [[nodiscard]] bool current(uint64_t inode, const block_map_t & map);
+
+        /// pointer tree of an inode changed and the map didn't follow, drop it
+        /// @param inode Inode block index
+        void changed(uint64_t inode);
+
+        /// drop block map of an inode
+        /// @param inode Inode block index
+        void invalidate(uint64_t inode);
+
+        /// move block map from one inode block to another, used when inode is relocated by CoW
+        /// @param from Old inode block index
+        /// @param to New inode block index
+        void relocate(uint64_t from, uint64_t to);
+
+        NO_COPY_OBJ(cfs_block_map_cache_t);
+    };
+
+    /// Transaction group (txg).
+    /// Blocks allocated while a transaction group is open can't be seen by any snapshot or any
+    /// previous root, so they are modified in place instead of CoW'd again, and the CoW chain up to the root
+    /// happens once per transaction group instead of once per operation.
+    /// Committing a group seals its blocks, next change to them will CoW again.
+    /// While enabled, a timer thread commits the group once it is open for longer than the timeout,
+    /// so a group is sealed even when nothing allocates anymore
+    class cfs_transaction_group_t
+    {
+        cfs_journaling_t * journal_;
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        std::mutex timer_mutex_; /// start and stop of the timer thread
+        std::thread timer_;
+        tsl::hopscotch_set < uint64_t > dirty_blocks_; /// blocks allocated in current group
+        uint64_t transaction_group_id_ = 0;
+        std::chrono::steady_clock::time_point opened_at_;
+        std::atomic_bool enabled_ = false;
+        uint64_t timeout_ = 0; /// seconds
+        uint64_t max_dirty_blocks_ = 0;
+
+        /// seal current group and open a new one
+        void commit_unblocked();
+
+        /// commit current group if it timed out or grew too large
+        void commit_if_needed_unblocked();
+
+        /// timer thread
+        void work();
+
+    public:
+        static constexpr uint64_t default_timeout = 5;
+        static constexpr uint64_t default_max_dirty_blocks = 64 * 1024;
+
+        explicit cfs_transaction_group_t(cfs_journaling_t * journal) : journal_(journal) { }
+
+        /// stop the timer, the open group is left as it is
+        ~cfs_transaction_group_t();
+
+        /// Set transaction group mode, disabled by default. Starts the timer thread when enabled, stops it when disabled
+        /// @param timeout Commit after this many seconds, 0 disables transaction groups
+        /// @param max_dirty_blocks Commit after this many blocks are allocated in one group
+        void set_mode(uint64_t timeout, uint64_t max_dirty_blocks = default_max_dirty_blocks);
+
+        /// Record a newly allocated block into current group
+        /// @param index Block index
+        void adopt(uint64_t index);
+
+        /// Check if a block belongs to current group, i.e., it can be modified in place
+        /// @param index Block index
+        /// @return true if block can be modified without CoW
+        [[nodiscard]] bool owns(uint64_t index);
+
+        /// Commit current group
+        void commit();
+
+        NO_COPY_OBJ(cfs_transaction_group_t);
+    };
+
+    /// Redundancy reclaimer.
+    /// CoW redundancies and blocks without references are queued, oldest first, the moment they become garbage
+    /// (see cfs_block_attribute_access_t::set_reclaimable_hook()), so no one has to scan the device to find them.
+    /// A background thread gives them back to the bitmap whenever free space drops below the retention watermark,
+    /// redundancies above it are kept. Allocation reclaims in foreground only when there is no free block at all.
+    class cfs_redundancy_reclaimer_t {
+        cfs_bitmap_block_mirroring_t * bitmap_;
+        cfs_block_attribute_access_t * block_attribute_;
+        cfs_journaling_t * journal_;
+        const uint64_t blocks_;
+
+        std::mutex mutex_;
+        std::mutex gate_mutex_; /// held while a block is re-checked and freed, see hold()
+        std::condition_variable condition_;
+        std::deque < uint64_t > queue_; /// oldest first
+        tsl::hopscotch_set < uint64_t > queued_; /// blocks in queue_, a block is never queued twice
+        std::atomic < uint64_t > watermark_ = 0; /// free blocks to keep
+        std::atomic_bool running_ = false;
+        std::thread worker_;
+
+        /// still garbage? queued blocks are only ever freed by reclaim(), so a popped block can't be a new allocation
+        [[nodiscard]] bool reclaimable(uint64_t index);
+
+        /// background thread
+        void work();
+
+    public:
+        static constexpr uint64_t default_watermark_percent = 5;
+        static constexpr uint64_t batch = 64; /// blocks reclaimed per round
+
+        /// queue every garbage block found in the bitmap, in block order as their age is unknown
+        cfs_redundancy_reclaimer_t(
+            cfs_bitmap_block_mirroring_t * bitmap,
+            cfs_block_attribute_access_t * block_attribute,
+            cfs_journaling_t * journal,
+            uint64_t blocks);
+        ~cfs_redundancy_reclaimer_t() { stop(); }
+        NO_COPY_OBJ(cfs_redundancy_reclaimer_t)
+
+        /// queue a block that just became garbage, ignored if already queued
+        /// @param index Block index
+        void push(uint64_t index);
+
+        /// free the oldest garbage blocks
+        /// @param count Blocks to free at most
+        /// @return Blocks freed, 0 only when the queue ran empty
+        uint64_t reclaim(uint64_t count);
+
+        /// keep reclaim() from freeing anything while the lock is held. Whoever hands out references to
+        /// garbage blocks again holds it, so a block can't come back to life between the re-check and the clear.
+        /// Nothing that allocates may run under it, allocation reclaims in foreground when the device is full
+        /// @return Lock on the gate
+        [[nodiscard]] std::unique_lock < std::mutex > hold() { return std::unique_lock(gate_mutex_); }
+
+        /// set retention watermark
+        /// @param percent Background reclaim starts when free blocks drop below this percentage of all blocks
+        void set_watermark(uint64_t percent) { watermark_ = blocks_ * std::min<uint64_t>(percent, 100) / 100; }
+
+        /// wake the background thread up if free space is below the watermark
+        void notify();
+
+        /// start background thread
+        void start();
+
+        /// stop background thread, foreground reclaim keeps working
+        void stop();
+
+        /// blocks waiting in queue
+        [[nodiscard]] uint64_t queued();
+    };
+
     class cfs_block_manager_t {
         cfs_bitmap_block_mirroring_t * bitmap_;
         filesystem::cfs_header_block_t * header_;
         cfs_block_attribute_access_t * block_attribute_;
         cfs_journaling_t * journal_;
+        cfs_block_map_cache_t block_map_cache_;
+        cfs_transaction_group_t transaction_group_;
+        cfs_redundancy_reclaimer_t reclaimer_;
+
+        /// inode and pointer blocks prefer the head of the data region, so tree walks stay within a few pages
+        static constexpr uint64_t metadata_area_ratio = 32; /// 1/32 of all blocks
+        uint64_t map_size_;
+        uint64_t metadata_area_end_;
+
+        /// allocating threads are spread over slots, every slot starts in its own allocation group (bitmap page)
+        /// after the metadata area and keeps its own cursor, so concurrent writers don't scan or claim from the same page
+        static constexpr uint64_t allocation_slots = 64;
+        static constexpr uint64_t stream_window = 256; /// blocks left behind a new run so its file can keep growing in place
+        struct alignas(64) allocation_cursor_t { std::atomic < uint64_t > next = 0; };
+        std::array < allocation_cursor_t, allocation_slots > cursors_;
+
+        /// allocation cursor of the calling thread
+        [[nodiscard]] std::atomic < uint64_t > & cursor();
+
+        /// reset attributes of a block just claimed in the bitmap, and hand it to the transaction group
+        void prepare_claimed_block(uint64_t index);
+
+        /// journal a run of bits just claimed, so replay can give them back if their owner was interrupted
+        /// @param start First block
+        /// @param count Blocks in the run
+        void journal_claim(uint64_t start, uint64_t count);
 
     public:
         cfs_block_manager_t(
@@ -523,11 +1054,35 @@ namespace cfs
             filesystem::cfs_header_block_t * header,
             cfs_block_attribute_access_t * block_attribute,
             cfs_journaling_t * journal);
+        ~cfs_block_manager_t() { block_attribute_->set_reclaimable_hook(nullptr); }
 
         /// allocate a new block
+        /// @param goal Preferred block, search starts there, UINT64_MAX to start at the calling thread's cursor
         /// @return New block index
         /// @throws cfs::error::no_more_free_spaces Space ran out
-        [[nodiscard]] uint64_t allocate();
+        [[nodiscard]] uint64_t allocate(uint64_t goal = UINT64_MAX);
+
+        /// allocation goal for an inode or pointer block
+        /// @param near Related block, usually the inode the new block belongs to
+        /// @return near if it lies in the metadata area, otherwise the start of the area
+        [[nodiscard]] uint64_t metadata_goal(const uint64_t near) const { return near < metadata_area_end_ ? near : 0; }
+
+        /// allocation goal for file data
+        /// @param previous Block holding the data right before the new one
+        /// @return The block after previous, or UINT64_MAX (thread cursor) if that falls in the metadata area
+        [[nodiscard]] uint64_t storage_goal(const uint64_t previous) const {
+            return previous >= metadata_area_end_ && previous + 1 < map_size_ ? previous + 1 : UINT64_MAX;
+        }
+
+        using extents_t = std::vector < std::pair < uint64_t, uint64_t > >; /// [start, length]
+
+        /// allocate blocks as few contiguous extents as possible
+        /// @param count Blocks to allocate
+        /// @param type Block type of the new blocks
+        /// @param goal Preferred first block, search starts there, UINT64_MAX to start at the calling thread's cursor
+        /// @return Extents in allocation order, lengths add up to count
+        /// @throws cfs::error::no_more_free_spaces Space ran out
+        [[nodiscard]] extents_t allocate_range(uint64_t count, uint8_t type, uint64_t goal = UINT64_MAX);
 
         /// deallocate a block
         /// @param index Block index
@@ -536,8 +1091,32 @@ namespace cfs
         /// dump bitmap data
         [[nodiscard]] std::vector<uint8_t> dump_bitmap_data() const { return bitmap_->dump(); }
 
+        /// dump bitmap pages changed since last call
+        /// @param all Dump every page, changed or not
+        [[nodiscard]] cfs_bitmap_block_mirroring_t::dirty_pages_t dump_dirty_bitmap_pages(const bool all = false) const {
+            return bitmap_->dump_dirty_pages(all);
+        }
+
+        /// bring the bitmap mirror up to date
+        void commit_bitmap() const { (void)bitmap_->commit(); }
+
+        /// bring the bitmap mirror up to date every few seconds at most
+        void commit_bitmap_periodically() const { bitmap_->commit_periodically(); }
+
         /// get allocation status of a block
         [[nodiscard]] bool blk_at(const uint64_t index) const { return bitmap_->get_bit(index); }
+
+        /// get free block count without touching the header
+        [[nodiscard]] uint64_t free_blocks() const { return bitmap_->free_bits(); }
+
+        /// inode block map cache
+        [[nodiscard]] cfs_block_map_cache_t & block_map_cache() { return block_map_cache_; }
+
+        /// transaction group
+        [[nodiscard]] cfs_transaction_group_t & transaction_group() { return transaction_group_; }
+
+        /// redundancy reclaimer
+        [[nodiscard]] cfs_redundancy_reclaimer_t & reclaimer() { return reclaimer_; }
     };
 
     template < typename F> concept Allocator_ = requires(F f, const uint8_t c) { { std::invoke(f, c) } -> std::same_as<uint64_t>; };
@@ -559,6 +1138,8 @@ namespace cfs
         cfs_block_attribute_access_t * block_attribute_;
         const uint64_t block_size_;
         const uint64_t block_index_;
+        cfs_block_map_cache_t::block_map_ptr_t block_map_; /// block map of this inode, nullptr if not loaded yet
+        std::map < uint64_t, uint64_t > before_images_; /// blocks overwritten in place by the current write -> their copies
 
         struct linearized_block_t {
             std::vector < uint64_t > level1_pointers;
@@ -600,7 +1181,30 @@ namespace cfs
             ~page_locker_t();
         };
 
+        class continuous_page_locker_t
+        {
+            filesystem::guard_continuous lock_;
+            cfs_inode_service_t * parent_;
+            const uint64_t start_;
+
+        public:
+            const filesystem::guard_continuous * operator->() const { return &lock_; }
+
+            /**
+             * Automatic lock over a run of adjacent pages
+             * @param start First page index
+             * @param count Number of pages
+             * @param fs Filesystem manager
+             * @param parent Service parent
+             */
+            continuous_page_locker_t(uint64_t start, uint64_t count, filesystem * fs, cfs_inode_service_t * parent);
+
+            /// range destructor, automatically commit checksum changes of every page
+            ~continuous_page_locker_t();
+        };
+
         friend class page_locker_t;
+        friend class continuous_page_locker_t;
 
         /// lock data block ID
         /// @param index data block ID
@@ -608,16 +1212,127 @@ namespace cfs
         /// @return page lock
         [[nodiscard]] page_locker_t lock_page(uint64_t index, bool linker = false);
 
+        /// lock data block ID in shared (reader) mode, page is read only so checksum is left alone
+        /// @param index data block ID
+        /// @param linker Linker statement flag. Set to false and attempt to read a pointer will cause error
+        /// @return shared page lock
+        [[nodiscard]] filesystem::shared_guard lock_page_shared(uint64_t index, bool linker = false);
+
+        /// lock a run of adjacent data blocks, none of them can be a pointer
+        /// @param start first data block ID
+        /// @param count number of blocks
+        /// @return range page lock
+        [[nodiscard]] continuous_page_locker_t lock_pages_continuous(uint64_t start, uint64_t count);
+
+        /// lock a run of adjacent data blocks in shared (reader) mode, none of them can be a pointer
+        /// @param start first data block ID
+        /// @param count number of blocks
+        /// @return range lock
+        [[nodiscard]] filesystem::guard_continuous lock_pages_continuous_shared(uint64_t start, uint64_t count);
+
         /// copy-on-write for one block
         /// @param index Block index
         /// @param linker Linker statement flag. Set to false and attempt to read a pointer will cause error
         /// @return Redundancy block index
         uint64_t copy_on_write(uint64_t index, bool linker = false);
 
+        /// copy a block into a redundancy the caller already allocated
+        /// @param index Block index
+        /// @param new_block Redundancy block index, allocated as STORAGE_BLOCK
+        /// @param linker Linker statement flag
+        /// @return new_block
+        uint64_t copy_to_redundancy(uint64_t index, uint64_t new_block, bool linker = false);
+
+        /// allocate blocks through allocate_range() and flatten the extents
+        /// @param count Blocks to allocate
+        /// @param type Block type of the new blocks
+        /// @param goal Preferred first block, UINT64_MAX for the thread cursor
+        /// @return Block indexes, in allocation order
+        std::vector < uint64_t > allocate_blocks(uint64_t count, uint8_t type, uint64_t goal = UINT64_MAX);
+
         /// Linearize all blocks by st_size
         /// @return linearized pointers in std::vector <uint64_t> * 3 struct
         [[nodiscard]] linearized_block_t linearize_all_blocks();
 
+        /// Walk the whole pointer tree on disk by st_size
+        /// @return linearized pointers in std::vector <uint64_t> * 3 struct
+        [[nodiscard]] linearized_block_t linearize_all_blocks_from_disk();
+
+        /// Get block map of this inode, from the block map cache if it's still current,
+        /// or by walking the pointer tree (the result is then cached)
+        /// @return Block map
+        [[nodiscard]] cfs_block_map_cache_t::block_map_ptr_t block_map();
+
+        /// Get block map of this inode only if it's already loaded or cached, never walks the pointer tree
+        /// @return Block map, nullptr if not available
+        [[nodiscard]] cfs_block_map_cache_t::block_map_ptr_t cached_block_map();
+
+        /// Resolve one logical block to its storage block.
+        /// Uses the block map if it's loaded, otherwise reads one level 1 and one level 2 pointer block
+        /// @param logical_block Logical block, i.e., offset / block size
+        /// @return Storage block index
+        /// @throws cfs::error::assertion_failed Out of bounds
+        [[nodiscard]] uint64_t resolve_block(uint64_t logical_block);
+
+        /// Check if a block can be modified without CoW, that is, it belongs to current transaction group,
+        /// or overwrite-if-exclusive policy (or NOCOW of this inode, for data blocks) is on and no snapshot
+        /// can see it (status BLOCK_AVAILABLE_TO_MODIFY_0x00 and referenced once at most).
+        /// Only tells, the overwrite itself is journaled by keep_before_image()
+        /// @param index Block index
+        /// @param data_block Block holds file data, so NOCOW of this inode applies to it
+        /// @return true if block can be modified in place
+        [[nodiscard]] bool modifiable_in_place(uint64_t index, bool data_block = false);
+
+        /// Copy a block about to be overwritten in place, so replay can undo an interrupted write.
+        /// Blocks of the current transaction group aren't copied, nor is a block twice in one write
+        /// @param index Block index
+        /// @param linker Linker statement flag
+        void keep_before_image(uint64_t index, bool linker = false);
+
+        /// Retire the copies keep_before_image() made, once the write no longer needs them
+        void release_before_images();
+
+        /// Mark a block replaced by CoW as redundancy, or delink it if it's still referenced by snapshots
+        /// @param index Replaced block index
+        void retire_block(uint64_t index);
+
+        /// CoW one pointer block and patch pointers inside it
+        /// @param index Pointer block index
+        /// @param patches [pointer offset in block, new pointer]
+        /// @return New pointer block index, same as index if CoW didn't happen
+        uint64_t relink_pointer_block(uint64_t index, const std::vector < std::pair < uint64_t, uint64_t > > & patches);
+
+        using pointer_patches_t = std::vector < std::pair < uint64_t, uint64_t > >; /// [pointer offset, new pointer]
+
+        /// Patch pointers on one level of the pointer tree.
+        /// Existing pointer blocks holding patched pointers are CoW'd (once each), missing ones are allocated
+        /// @param patches [offset of the pointer on this level, new pointer], sorted by offset
+        /// @param existing_blocks How many pointer blocks this level currently has
+        /// @param pointer_block Get existing pointer block by its offset on this level
+        /// @return [offset of the pointer block, new pointer block] for every relocated or allocated pointer block,
+        /// i.e., patches for the upper level
+        pointer_patches_t patch_pointer_level(
+            const pointer_patches_t & patches,
+            uint64_t existing_blocks,
+            const std::function < uint64_t (uint64_t) > & pointer_block);
+
+        /// Patch level 3 pointers from level 2 up to the inode, only pointer blocks on the way are touched
+        /// @param level3_patches [logical block, new storage block], sorted by logical block
+        /// @param descriptor Pointer tree geometry before patching
+        void patch_pointer_tree(const pointer_patches_t & level3_patches, const linearized_block_descriptor_t & descriptor);
+
+        /// Relink storage blocks replaced by CoW, only pointer blocks on the way to these blocks are touched
+        /// @param relink_map [logical block, new storage block]
+        void relink_storage_blocks(const std::map < uint64_t, uint64_t > & relink_map);
+
+        /// Grow this inode. Only new tail blocks are allocated and only the last pointer blocks are patched
+        /// @param new_size New size, larger than current size
+        void extend_unblocked(uint64_t new_size);
+
+        /// Replace block map of this inode after pointers are committed
+        /// @param descriptor Allocation map that was just committed
+        void update_block_map(const allocation_map_t & descriptor);
+
         /// calculate how many pointers for each level
         /// @return pointers required for each level for this particular size
         [[nodiscard]] linearized_block_descriptor_t size_to_linearized_block_descriptor(uint64_t size) const;
@@ -728,6 +1443,7 @@ namespace cfs
         void chdev(dev_t dev);                // change st_dev
         void chrdev(dev_t dev);             // change st_rdev
         void chmod(mode_t mode);               // change st_mode
+        void chflags(uint32_t flags);          // change st_flags
         void chown(uid_t uid, gid_t gid);       // change st_uid, st_gid
         void set_atime(timespec st_atim);   // change st_atim
         void set_ctime(timespec st_ctim);   // change st_ctim
@@ -70,7 +70,13 @@ namespace cfs
         /// a concept called "per-snapshot bitmap" was firstly introduced.
         /// More info: Dave Hitz, James Lau, and Michael Malcolm: File System Design for an NFS File Server Appliance, 1994
         /// (https://www.netapp.com/media/23880-file-system-design.pdf)
-        void root_cow();
+        /// @param rewrite_bitmap Write the whole bitmap into the new root, not only the pages changed since the previous root
+        void root_cow(bool rewrite_bitmap = false);
+
+        /// read the bitmap kept in root metadata: the live bitmap as of the last root CoW for a root,
+        /// the bitmap of the snapshot for a snapshot entry
+        /// @return Bitmap data, size is the size of the on-disk bitmap
+        [[nodiscard]] std::vector<uint8_t> read_root_bitmap_unblocked() const;
 
         /// @param cow_index Current child inode index
         /// @param content Inode content for CoW. Parent cannot lock inode when it's in use so
@@ -124,6 +130,7 @@ namespace cfs
         void chdev(dev_t dev);                // change st_dev
         void chrdev(dev_t dev);             // change st_rdev
         void chmod(mode_t mode);               // change st_mode
+        void chflags(uint32_t flags);          // change st_flags
         void chown(uid_t uid, gid_t gid);       // change st_uid, st_gid
         void set_atime(timespec st_atim);   // change st_atim
         void set_ctime(timespec st_ctim);   // change st_ctim
@@ -132,6 +139,9 @@ namespace cfs
         /// get struct stat
         [[nodiscard]] struct stat get_stat();
 
+        /// bitmap kept in root metadata, see read_root_bitmap_unblocked()
+        [[nodiscard]] std::vector<uint8_t> read_root_bitmap();
+
         /// Return inode content size
         uint64_t size();
 
@@ -230,7 +240,9 @@ namespace cfs
         const auto ptr = dentry_map_.find(name);
         cfs_assert_simple (ptr == dentry_map_.end());
         copy_on_write(); // relink
-        const auto new_index = inode_construct_info_.block_manager->allocate();
+        // new inodes go to the metadata area, next to their parent
+        const auto new_index = inode_construct_info_.block_manager->allocate(
+            inode_construct_info_.block_manager->metadata_goal(current_referenced_inode_));
         // clear inode data
         {
             inode_construct_info_.block_attribute->clear(new_index, {
@@ -251,6 +263,7 @@ namespace cfs
                     .st_dev = 0,
                     .st_ino = new_index,
                     .st_mode = S_IFDIR | 0755,
+                    .st_flags = 0,
                     .st_nlink = 1,
                     .st_uid = getuid(),
                     .st_gid = getgid(),
@@ -268,6 +281,7 @@ namespace cfs
                     .st_dev = 0,
                     .st_ino = new_index,
                     .st_mode = S_IFREG | 0755,
+                    .st_flags = 0,
                     .st_nlink = 1,
                     .st_uid = getuid(),
                     .st_gid = getgid(),
@@ -285,6 +299,7 @@ namespace cfs
                     .st_dev = 0,
                     .st_ino = new_index,
                     .st_mode = S_IFREG | 0755,
+                    .st_flags = 0,
                     .st_nlink = 1,
                     .st_uid = getuid(),
                     .st_gid = getgid(),
@@ -297,6 +312,7 @@ namespace cfs
                     .st_ctim = now,
                 };
             }
+            inode_stat.st_flags = get_stat_unblocked().st_flags & inode_flags_inherited;
             std::memcpy(new_lock.data(), &inode_stat, sizeof(inode_stat)); // new inode struct stat
         }
 
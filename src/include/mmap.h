@@ -15,6 +15,7 @@ namespace cfs::basic_io
         int fd = -1;
         void * data_ = MAP_FAILED;
         unsigned long long int size_ = 0;
+        bool read_only_ = false;
     public:
         mmap() noexcept = default;
 
@@ -25,15 +26,17 @@ namespace cfs::basic_io
 
         /// open the file
         /// @param file path to file
+        /// @param read_only Map privately, changes stay in memory and never reach the file
         /// @throws cfs::error::BasicIOcannotOpenFile Cannot mmap file
-        explicit mmap(const std::string & file) { open(file); }
+        explicit mmap(const std::string & file, const bool read_only = false) { open(file, read_only); }
 
         ~mmap() noexcept;
 
         /// open the file
         /// @param file path to file
+        /// @param read_only Map privately, changes stay in memory and never reach the file
         /// @throws cfs::error::BasicIOcannotOpenFile Cannot mmap file
-        void open(const std::string & file);
+        void open(const std::string & file, bool read_only = false);
 
         /// close the file
         /// @throws cfs::error::assertion_failed Can't sync or unmap
@@ -11,6 +11,8 @@
 #include <thread>
 #include <map>
 #include <condition_variable>
+#include <array>
+#include "tsl/hopscotch_map.h"
 #include "generalCFSbaseError.h"
 #include "mmap.h"
 #include "utils.h"
@@ -31,12 +33,14 @@ namespace cfs
     class last_check_timestamp { };
     class flags { };
 
-    /// bitmap base class
+    /// bitmap base class.
+    /// Bits are LSB first in every byte, every bit operation is a single atomic access, no mutex involved.
+    /// A bit lives in a 64bit word if the whole word is inside the array (and the array is aligned), otherwise
+    /// (tail bytes) in its byte, so a bit is always accessed with the same width
     class bitmap_base
     {
     protected:
         uint8_t * data_array_ = nullptr;
-        std::mutex array_mtx_;
         const uint64_t particles_ = 0;
         const uint64_t bytes_required_ = 0;
 
@@ -50,6 +54,17 @@ namespace cfs
         /// @throws cfs::error::assertion_failed Init failed
         void init(uint64_t required_blocks);
 
+    private:
+        bool word_aligned_ = false;
+
+        /// 64bit word holding the bit, nullptr if the bit has to be accessed by byte
+        [[nodiscard]] uint64_t * word_at(const uint64_t index) const noexcept
+        {
+            const uint64_t offset = index / 64 * sizeof(uint64_t);
+            return word_aligned_ && offset + sizeof(uint64_t) <= bytes_required_
+                ? reinterpret_cast<uint64_t *>(data_array_ + offset) : nullptr;
+        }
+
     public:
         bitmap_base() noexcept = default;
         virtual ~bitmap_base() noexcept = default;
@@ -59,14 +74,22 @@ namespace cfs
         /// @param index Bit Index
         /// @return The bit at the specific location
         /// @throws cfs::error::assertion_failed Out of bounds
-        bool get_bit(uint64_t index, bool use_mutex = true);
+        bool get_bit(uint64_t index);
 
         /// Set the bit at the specific location
         /// @param index Bit Index
         /// @param new_bit The new bit value
         /// @return NONE
         /// @throws cfs::error::assertion_failed Out of bounds
-        void set_bit(uint64_t index, bool new_bit, bool use_mutex = true);
+        void set_bit(uint64_t index, bool new_bit) { (void)exchange_bit(index, new_bit); }
+
+        /// Set the bit at the specific location and return what it was before, in one atomic operation
+        /// (test-and-set with new_bit = true, test-and-clear with new_bit = false)
+        /// @param index Bit Index
+        /// @param new_bit The new bit value
+        /// @return The bit before this call
+        /// @throws cfs::error::assertion_failed Out of bounds
+        bool exchange_bit(uint64_t index, bool new_bit);
     };
 
     /// Format a CFS
@@ -87,41 +110,48 @@ namespace cfs
 
     class cfs_bitmap_block_mirroring_t;
     class cfs_journaling_t;
+    class cfs_block_attribute_access_t;
 
     class filesystem
     {
     public:
         struct global_control_flags_t {
             uint64_t no_pointer_and_storage_cow:1; // disable root CoW, storage CoW, and all kinds of snapshots
-            uint64_t _reserved_:63;
+            uint64_t overwrite_exclusive_blocks:1; // modify blocks no snapshot can see in place instead of CoW
+            uint64_t _reserved_:62;
         };
 
         std::atomic < global_control_flags_t > global_control_flags;
         class guard_continuous;
+        /// Block lock table. Only blocks currently held are recorded, in a table sharded by block index,
+        /// each shard has its own mutex and wait queue so locks on unrelated blocks never contend.
+        /// A block is held either exclusively by one owner, or shared by any number of readers.
+        /// Writers go first: once a writer waits for a block, readers arriving after it wait too
         class block_shared_lock_t {
         public:
             const uint64_t blocks_ = 0;
 
         private:
-            class bitmap_t : public cfs::bitmap_base {
-            private:
-                std::vector <uint8_t> data;
+            static constexpr uint64_t shard_count = 64;
+            static constexpr int64_t exclusive_holder = -1;
 
-            public:
-                /// init bitmap
-                /// @param size bitmap size
-                /// @throws cfs::error::assertion_failed (thrown by init())
-                void create(uint64_t size);
-            } bitmap;
+            struct alignas(64) shard_t {
+                std::mutex mutex;
+                std::condition_variable cv;
+                tsl::hopscotch_map < uint64_t, int64_t > held; /// block -> reader count, or exclusive_holder
+                uint64_t waiters = 0;
+                tsl::hopscotch_map < uint64_t, uint64_t > writers_queued; /// block -> writers waiting for it
+            };
 
-        public:
-            /// init bitmap
-            /// @throws cfs::error::assertion_failed (thrown by bitmap::init())
-            void init() { bitmap.create(blocks_); }
+            std::array < shard_t, shard_count > shards_;
 
-        private:
-            std::mutex bitmap_mtx_;
-            std::condition_variable cv;
+            /// get the shard a block belongs to
+            shard_t & shard(const uint64_t index) noexcept { return shards_[index % shard_count]; }
+
+            /// call func(shard, index) for every shard the range reaches, index being its first block in range.
+            /// only fit for releasing, blocks are not visited in index order
+            template < typename Func >
+            void for_each_shard_in_range(uint64_t start, uint64_t count, Func && func);
 
         public:
             /// lock by index
@@ -132,6 +162,29 @@ namespace cfs
             /// @param index Block ID index
             void unlock(uint64_t index);
 
+            /// lock by index in shared (reader) mode, waits behind writers already queued for the block.
+            /// a reader must not take a block shared again while holding it
+            /// @param index Block ID index
+            void lock_shared(uint64_t index);
+
+            /// unlock by index in shared (reader) mode
+            /// @param index Block ID index
+            void unlock_shared(uint64_t index);
+
+            /// lock a contiguous range of blocks.
+            /// Blocks are taken in ascending index order, a range never holds a block while waiting for a lower one.
+            /// Two ranges, or a range and a locker taking single blocks in ascending order, never wait on each other in a cycle
+            /// @param start First block
+            /// @param count Number of blocks
+            /// @param shared Shared (reader) mode
+            void lock_range(uint64_t start, uint64_t count, bool shared);
+
+            /// unlock a contiguous range of blocks
+            /// @param start First block
+            /// @param count Number of blocks
+            /// @param shared Shared (reader) mode
+            void unlock_range(uint64_t start, uint64_t count, bool shared);
+
             NO_COPY_OBJ(block_shared_lock_t);
             block_shared_lock_t() noexcept = default;
             ~block_shared_lock_t() noexcept = default;
@@ -226,10 +279,11 @@ namespace cfs
 
         /// check headers, fix if possible, and create a bit state locker for all blocks
         /// @param path_to_block_file Path to block file
+        /// @param read_only Keep every change in memory, the block file is left exactly as it is
         /// @throws cfs::error::cannot_even_read_cfs_header_in_that_small_tiny_file Too small
         /// @throws cfs::error::not_even_a_cfs_filesystem Not CFS
         /// @throws cfs::error::filesystem_head_corrupt_and_unable_to_recover FS corrupt
-        explicit filesystem(const std::string & path_to_block_file);
+        explicit filesystem(const std::string & path_to_block_file, bool read_only = false);
 
         /// lock guard
         class guard {
@@ -270,12 +324,111 @@ namespace cfs
             friend class filesystem;
         };
 
+        /// shared (reader) lock guard, block data is read only
+        class shared_guard {
+        private:
+            block_shared_lock_t * bitlocker_;
+            const char * data_;
+            const uint64_t block_address_;
+            const uint64_t block_size_;
+
+            /// make shared lock guard
+            /// @param bitlocker global lock
+            /// @param data block data
+            /// @param block_address block ID
+            /// @param block_size Block size
+            /// @throws cfs::error::assertion_failed out of bounds
+            shared_guard(block_shared_lock_t *bitlocker, const char *data, const uint64_t block_address, const uint64_t block_size)
+                :
+            bitlocker_(bitlocker),
+            data_(data),
+            block_address_(block_address),
+            block_size_(block_size) {
+                bitlocker_->lock_shared(block_address_);
+            }
+
+        public:
+            /// @throws cfs::error::assertion_failed out of bounds
+            ~shared_guard() noexcept { bitlocker_->unlock_shared(block_address_); }
+
+            /// get the address of the currently locked block page
+            /// @return data pointer
+            [[nodiscard]] const char * data() const noexcept { return data_; }
+
+            /// return accessible size
+            /// @return accessible size
+            [[nodiscard]] uint64_t size() const noexcept { return block_size_; }
+
+            NO_COPY_OBJ(shared_guard);
+            friend class filesystem;
+        };
+
+        /// lock guard for a contiguous range of blocks, exposes one span over the whole range
+        class guard_continuous {
+        private:
+            block_shared_lock_t * bitlocker_;
+            char * data_;
+            const uint64_t start_;
+            const uint64_t blocks_;
+            const uint64_t block_size_;
+            const bool shared_;
+
+            /// make range lock guard
+            /// @param bitlocker global lock
+            /// @param data data of the first block
+            /// @param start first block ID
+            /// @param blocks number of blocks
+            /// @param block_size Block size
+            /// @param shared Shared (reader) mode, data must not be modified
+            /// @throws cfs::error::assertion_failed out of bounds
+            guard_continuous(block_shared_lock_t *bitlocker, char *data,
+                const uint64_t start, const uint64_t blocks, const uint64_t block_size, const bool shared)
+                :
+            bitlocker_(bitlocker),
+            data_(data),
+            start_(start),
+            blocks_(blocks),
+            block_size_(block_size),
+            shared_(shared) {
+                bitlocker_->lock_range(start_, blocks_, shared_);
+            }
+
+        public:
+            /// @throws cfs::error::assertion_failed out of bounds
+            ~guard_continuous() noexcept { bitlocker_->unlock_range(start_, blocks_, shared_); }
+
+            /// get the address of the first locked block, blocks are continuous in memory
+            /// @return data pointer
+            [[nodiscard]] char * data() const noexcept { return data_; }
+
+            /// return accessible size of the whole range
+            /// @return accessible size
+            [[nodiscard]] uint64_t size() const noexcept { return blocks_ * block_size_; }
+
+            NO_COPY_OBJ(guard_continuous);
+            friend class filesystem;
+        };
+
         /// Lock a certain block
         /// @param index Block ID to lock
         /// @return lock_guard
         /// @throws cfs::error::assertion_failed Invalid arguments
         [[nodiscard]] guard lock(uint64_t index);
 
+        /// Lock a contiguous range of blocks in one operation
+        /// @param start First block ID to lock
+        /// @param count Number of blocks
+        /// @param shared Shared (reader) mode, data must not be modified
+        /// @return range lock guard
+        /// @throws cfs::error::assertion_failed Invalid arguments
+        [[nodiscard]] guard_continuous lock_continuous(uint64_t start, uint64_t count, bool shared = false);
+
+        /// Lock a certain block in shared (reader) mode, other readers can hold it at the same time
+        /// @param index Block ID to lock
+        /// @return shared lock guard
+        /// @throws cfs::error::assertion_failed Invalid arguments
+        [[nodiscard]] shared_guard lock_shared(uint64_t index);
+
         /// flush all data, write clean flag, close file
         ~filesystem() noexcept;
 
@@ -283,6 +436,7 @@ namespace cfs
 
         friend class cfs_bitmap_block_mirroring_t;
         friend class cfs_journaling_t;
+        friend class cfs_block_attribute_access_t;
     };
 
     template<typename Type> requires (
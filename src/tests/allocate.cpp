@@ -0,0 +1,88 @@
+#include "smart_block_t.h"
+#include "cfsBasicComponents.h"
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <unistd.h>
+#include "utils.h"
+#include <chrono>
+
+// allocation benchmark, fills the image up to 90% and measures allocation latency when the allocator has
+// to run through the whole occupied area (every allocation asks for block 0 as its goal).
+// the per-bit scan the allocator used before is timed as a reference.
+// usage: allocate [DISK SIZE IN MB, default 256]
+int main(int argc, char ** argv)
+{
+    try
+    {
+        const char * disk = "bigfile.img";
+        const uint64_t disk_size = (argc > 1 ? std::stoull(argv[1]) : 256) * 1024 * 1024;
+        constexpr uint64_t rounds = 1000;
+        {
+            const int fd = open(disk, O_RDWR | O_CREAT, 0644);
+            assert_throw(fd > 0, "fd");
+            assert_throw(fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(disk_size)) == 0, "fallocate() failed");
+            assert_throw(fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, static_cast<off_t>(disk_size)) == 0, "fallocate() failed");
+            close(fd);
+            chmod(disk, 0755);
+            cfs::make_cfs(disk, 4096, "test");
+        }
+
+        cfs::filesystem fs(disk);
+        cfs::cfs_journaling_t journal(&fs);
+        cfs::cfs_bitmap_block_mirroring_t raid1_bitmap(&fs, &journal);
+        cfs::cfs_block_attribute_access_t block_attribute(&fs, &journal);
+        cfs::cfs_block_manager_t block_manager(&raid1_bitmap, &fs.cfs_header_block, &block_attribute, &journal);
+        const uint64_t len = fs.static_info_.data_table_end - fs.static_info_.data_table_start;
+        const uint64_t occupied = len * 9 / 10;
+        cfs_assert_simple(occupied + rounds < len);
+
+        for (uint64_t i = 0; i < occupied; i++) {
+            raid1_bitmap.set_bit(i, true);
+        }
+
+        // reference: bit by bit, every bit locks its bitmap page
+        const auto reference_start = std::chrono::steady_clock::now();
+        constexpr uint64_t reference_rounds = 20;
+        for (uint64_t round = 0; round < reference_rounds; round++)
+        {
+            uint64_t i = 0;
+            while (raid1_bitmap.get_bit(i)) i++;
+            cfs_assert_simple(i == occupied);
+        }
+        const std::chrono::duration<double, std::micro> reference_elapsed = std::chrono::steady_clock::now() - reference_start;
+
+        // word scan, done by the allocator
+        std::vector<uint64_t> allocated;
+        allocated.reserve(rounds);
+        const auto start = std::chrono::steady_clock::now();
+        for (uint64_t round = 0; round < rounds; round++)
+        {
+            const auto extents = block_manager.allocate_range(1, cfs::STORAGE_BLOCK, 0);
+            cfs_assert_simple(extents.size() == 1 && extents.front().second == 1);
+            allocated.push_back(extents.front().first);
+        }
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+
+        // verify: blocks are handed out in order right after the occupied area
+        for (uint64_t i = 0; i < rounds; i++)
+        {
+            cfs_assert_simple(allocated[i] == occupied + i);
+            cfs_assert_simple(raid1_bitmap.get_bit(allocated[i]));
+        }
+        cfs_assert_simple(raid1_bitmap.find_first_zero(0, len) == occupied + rounds);
+
+        ilog("blocks: ", len, ", occupied: ", occupied, "\n");
+        ilog("per-bit scan: ", reference_elapsed.count() / reference_rounds, " us per lookup\n");
+        ilog("word scan: ", elapsed.count() / rounds, " us per allocation\n");
+    }
+    catch (cfs::error::generalCFSbaseError & e) {
+        elog(e.what(), "\n");
+        return EXIT_FAILURE;
+    }
+    catch (std::exception& e) {
+        elog(e.what(), "\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include "smart_block_t.h"
+#include "cfsBasicComponents.h"
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <unistd.h>
+#include "utils.h"
+#include <chrono>
+#include <random>
+
+// append benchmark, streams a file in 128KB writes like FUSE does and prints throughput per segment.
+// throughput should stay flat as the file grows.
+// usage: append [FILE SIZE IN MB, default 128]
+int main(int argc, char ** argv)
+{
+    try
+    {
+        const char * disk = "bigfile.img";
+        const uint64_t file_size = (argc > 1 ? std::stoull(argv[1]) : 128) * 1024 * 1024;
+        const uint64_t disk_size = file_size * 4; // room for CoW redundancies
+        constexpr uint64_t write_size = 128 * 1024;
+        constexpr int segments = 8;
+        {
+            const int fd = open(disk, O_RDWR | O_CREAT, 0644);
+            assert_throw(fd > 0, "fd");
+            assert_throw(fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(disk_size)) == 0, "fallocate() failed");
+            assert_throw(fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, static_cast<off_t>(disk_size)) == 0, "fallocate() failed");
+            close(fd);
+            chmod(disk, 0755);
+            cfs::make_cfs(disk, 4096, "test");
+        }
+
+        cfs::filesystem fs(disk);
+        cfs::cfs_journaling_t journal(&fs);
+        cfs::cfs_bitmap_block_mirroring_t raid1_bitmap(&fs, &journal);
+        cfs::cfs_block_attribute_access_t block_attribute(&fs, &journal);
+        cfs::cfs_block_manager_t block_manager(&raid1_bitmap, &fs.cfs_header_block, &block_attribute, &journal);
+        raid1_bitmap.set_bit(0, true); // mark 0 as allocated
+        raid1_bitmap.set_bit(1, true);
+        block_attribute.set<cfs::block_type>(1, cfs::INDEX_NODE_BLOCK);
+
+        std::vector<char> buffer(write_size);
+        std::mt19937 rng(std::random_device{}());
+        std::ranges::generate(buffer, [&]{ return static_cast<char>(rng()); });
+
+        const uint64_t writes_per_segment = file_size / write_size / segments;
+        uint64_t offset = 0;
+        std::vector<double> throughput;
+        for (int segment = 0; segment < segments; segment++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < writes_per_segment; i++)
+            {
+                // inode service is rebuilt for every write, as it is for every FUSE call
+                cfs::cfs_inode_service_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+                buffer[0] = static_cast<char>(offset / write_size);
+                cfs_assert_simple(inode.write(buffer.data(), buffer.size(), offset) == buffer.size());
+                offset += write_size;
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            throughput.push_back(static_cast<double>(writes_per_segment * write_size) / 1024 / 1024 / elapsed.count());
+            ilog("segment ", segment, " (", offset / 1024 / 1024, "MB): ", throughput.back(), " MB/s\n");
+        }
+
+        // verify data
+        cfs::cfs_inode_service_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+        cfs_assert_simple(inode.get_stat().st_size == offset);
+        std::vector<char> read_back(write_size);
+        for (uint64_t i = 0; i < offset; i += write_size)
+        {
+            buffer[0] = static_cast<char>(i / write_size);
+            cfs_assert_simple(inode.read(read_back.data(), read_back.size(), i) == read_back.size());
+            cfs_assert_simple(read_back == buffer);
+        }
+
+        ilog("first segment: ", throughput.front(), " MB/s, last segment: ", throughput.back(), " MB/s\n");
+    }
+    catch (cfs::error::generalCFSbaseError & e) {
+        elog(e.what(), "\n");
+        return EXIT_FAILURE;
+    }
+    catch (std::exception& e) {
+        elog(e.what(), "\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
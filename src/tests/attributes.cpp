@@ -28,7 +28,7 @@ int main(int argc, char ** argv)
 
         std::random_device dev, dev2;
         std::mt19937 rng(dev()), rng_result(dev());
-        std::uniform_int_distribution<std::mt19937::result_type> dist6(0, len - 1);
+        std::uniform_int_distribution<std::mt19937::result_type> dist6(1, len - 1); // block 0 is the root inode
         std::uniform_int_distribution<std::mt19937::result_type> result(1, 0xFFFF);
         std::mutex random_use_mutex;
 
@@ -78,10 +78,60 @@ int main(int argc, char ** argv)
         });
 
         uint64_t size = 0;
-        for (int i = 0; i < len; i++) {
+        for (int i = 1; i < len; i++) {
             size += attribute.get<cfs::index_node_referencing_number>(i) != 0;
         }
         cfs_assert_simple(size == bit_random_map.size());
+
+        // fields sharing one entry are changed by compare-and-swap, no update is lost
+        {
+            constexpr uint64_t rounds = 10000;
+            attribute.clear(0);
+            std::vector<std::thread> counters;
+            for (int i = 0; i < 4; i++)
+            {
+                counters.emplace_back([&, i] {
+                    for (uint64_t round = 0; round < rounds; round++) {
+                        attribute.inc<cfs::index_node_referencing_number>(0);
+                        attribute.set<cfs::block_checksum>(0, i);
+                    }
+                });
+            }
+
+            std::ranges::for_each(counters, [](std::thread & T) { T.join(); });
+            cfs_assert_simple(attribute.get<cfs::index_node_referencing_number>(0) == 4 * rounds);
+            cfs_assert_simple(attribute.get<cfs::block_checksum>(0) < 4);
+            cfs_assert_simple(attribute.get<cfs::block_type>(0) == 0 && attribute.get<cfs::block_status>(0) == 0);
+        }
+
+        // full-table passes only visit blocks set in the bitmap
+        {
+            std::vector<uint8_t> bitmap((len + 7) / 8, 0);
+            for (const uint64_t index : { 1ul, 2ul, 70ul, len - 1 })
+            {
+                attribute.clear(index, { .block_type = cfs::STORAGE_BLOCK });
+                bitmap[index / 8] |= static_cast<uint8_t>(1u << (index % 8));
+            }
+            attribute.clear(2, { .block_type = cfs::COW_REDUNDANCY_BLOCK });
+            attribute.clear(3, { .block_type = cfs::STORAGE_BLOCK }); // not in bitmap
+
+            auto is_cow = [](const cfs::cfs_block_attribute_t & attr) { return attr.block_type == cfs::COW_REDUNDANCY_BLOCK; };
+            cfs_assert_simple(attribute.count_if(bitmap, [](const cfs::cfs_block_attribute_t &) { return true; }) == 4);
+            cfs_assert_simple(attribute.count_if(bitmap, is_cow) == 1);
+            cfs_assert_simple(attribute.remove_if(bitmap, is_cow) == 1);
+            cfs_assert_simple(!(bitmap[0] & (1u << 2)));
+
+            const auto changed = attribute.update_each(bitmap, [](cfs::cfs_block_attribute_t & attr) {
+                if (attr.block_type != cfs::COW_REDUNDANCY_BLOCK) attr.index_node_referencing_number = 2;
+            });
+            cfs_assert_simple(changed == 3);
+            cfs_assert_simple(attribute.update_each(bitmap, [](cfs::cfs_block_attribute_t & attr) {
+                attr.index_node_referencing_number = 2;
+            }) == 0);
+            cfs_assert_simple(attribute.get<cfs::index_node_referencing_number>(70) == 2);
+            cfs_assert_simple(attribute.get<cfs::index_node_referencing_number>(len - 1) == 2);
+            cfs_assert_simple(attribute.get<cfs::index_node_referencing_number>(3) == 0);
+        }
     }
     catch (cfs::error::generalCFSbaseError & e) {
         elog(e.what(), "\n");
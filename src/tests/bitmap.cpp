@@ -32,6 +32,34 @@ int main()
 {
     try
     {
+        // racing test-and-set over the same bits claims every bit exactly once, tail bits included
+        {
+            constexpr uint64_t small_len = 64 * 64 + 3;
+            bitmap small(small_len);
+            std::atomic < uint64_t > claimed = 0;
+            std::vector<std::thread> racers;
+            for (int i = 0; i < 4; i++)
+            {
+                racers.emplace_back([&] {
+                    for (uint64_t bit = 0; bit < small_len; bit++) {
+                        if (!small.exchange_bit(bit, true)) ++claimed;
+                    }
+                });
+            }
+
+            std::ranges::for_each(racers, [](std::thread & T0) { T0.join(); });
+            if (claimed != small_len) {
+                return EXIT_FAILURE;
+            }
+
+            for (uint64_t bit = 0; bit < small_len; bit++)
+            {
+                if (!small.exchange_bit(bit, false) || small.get_bit(bit)) {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+
         constexpr uint64_t len = 512 * 1000 * 1000 * 1000ull / 4096;
         bitmap bitmap(len);
 
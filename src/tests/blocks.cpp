@@ -56,6 +56,155 @@ int main(int argc, char ** argv)
 
         pthread_setname_np(pthread_self(), "main");
         std::ranges::for_each(threads, [](std::thread & T) { if (T.joinable()) T.join(); });
+
+        // mutual exclusion, including blocks sharing one lock table shard
+        auto T1 = [&](const uint64_t index)
+        {
+            for (int i = 0; i < 10000; i++)
+            {
+                auto lock = fs.lock(index);
+                auto * value = reinterpret_cast<uint64_t *>(lock.data());
+                const uint64_t v = *value;
+                std::this_thread::yield();
+                *value = v + 1;
+            }
+        };
+
+        for (const uint64_t index : { 7, 7 + 64 }) {
+            auto lock = fs.lock(index);
+            *reinterpret_cast<uint64_t *>(lock.data()) = 0;
+        }
+
+        threads.clear();
+        for (int i = 0; i < 4; i++) {
+            threads.emplace_back(T1, 7);
+            threads.emplace_back(T1, 7 + 64);
+        }
+        std::ranges::for_each(threads, [](std::thread & T) { if (T.joinable()) T.join(); });
+
+        for (const uint64_t index : { 7, 7 + 64 }) {
+            auto lock = fs.lock(index);
+            cfs_assert_simple(*reinterpret_cast<uint64_t *>(lock.data()) == 40000);
+        }
+
+        // shared locks: readers hold the block together, writer waits for all of them
+        {
+            std::atomic_int readers(0);
+            std::atomic_bool writer_done(false);
+            auto reader = [&]
+            {
+                const auto lock = fs.lock_shared(7);
+                ++readers;
+                while (readers != 2) std::this_thread::yield(); // both readers are inside at the same time
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                cfs_assert_simple(!writer_done);
+            };
+
+            std::thread R1(reader), R2(reader);
+            while (readers != 2) std::this_thread::yield();
+            {
+                auto lock = fs.lock(7);
+                writer_done = true;
+            }
+            R1.join();
+            R2.join();
+        }
+
+        // a reader arriving while a writer waits goes after the writer, even though the block is only held shared
+        {
+            std::atomic_bool writer_done(false), late_reader_done(false);
+            std::thread W, R;
+            {
+                const auto lock = fs.lock_shared(9);
+                W = std::thread([&] {
+                    auto writer = fs.lock(9);
+                    cfs_assert_simple(!late_reader_done);
+                    writer_done = true;
+                });
+                std::this_thread::sleep_for(std::chrono::milliseconds(50)); // writer is queued
+                R = std::thread([&] {
+                    const auto reader = fs.lock_shared(9);
+                    cfs_assert_simple(writer_done);
+                    late_reader_done = true;
+                });
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                cfs_assert_simple(!late_reader_done);
+            }
+            W.join();
+            R.join();
+        }
+
+        // range locks: one span over all blocks, a block inside the range waits for the whole guard
+        {
+            std::atomic_bool range_released(false);
+            std::thread T;
+            {
+                const auto range = fs.lock_continuous(10, 100);
+                cfs_assert_simple(range.size() == 100 * fs.static_info_.block_size);
+                T = std::thread([&] {
+                    const auto lock = fs.lock(77);
+                    cfs_assert_simple(range_released);
+                });
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                range_released = true;
+            }
+            T.join();
+        }
+
+        // short ranges not aligned to the lock table, one of them wrapping over the last shard
+        for (const auto & [start, count] : { std::pair<uint64_t, uint64_t>{ 1000, 3 }, { 62, 4 } })
+        {
+            std::atomic_bool range_released(false);
+            std::vector<std::thread> waiters;
+            {
+                const auto range = fs.lock_continuous(start, count);
+                for (uint64_t index = start; index < start + count; index++)
+                {
+                    waiters.emplace_back([&, index] {
+                        const auto lock = fs.lock(index);
+                        cfs_assert_simple(range_released);
+                    });
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                range_released = true;
+            }
+            std::ranges::for_each(waiters, [](std::thread & T) { T.join(); });
+        }
+
+        // a range wrapping over the last shard waits for a held block without holding any block past it,
+        // so a locker holding 63 can go on to 64 while the range waits for 63
+        {
+            std::atomic_bool upper_taken(false);
+            std::thread range_locker, upper_locker;
+            {
+                const auto lower = fs.lock(63);
+                range_locker = std::thread([&] { const auto range = fs.lock_continuous(60, 8); });
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                upper_locker = std::thread([&] {
+                    const auto upper = fs.lock(64);
+                    upper_taken = true;
+                });
+
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+                while (!upper_taken)
+                {
+                    if (std::chrono::steady_clock::now() > deadline) {
+                        elog("range holds a block past the one it waits for\n");
+                        abort();
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+                upper_locker.join();
+            }
+            range_locker.join();
+        }
+
+        {
+            // overlapping shared ranges
+            const auto r1 = fs.lock_continuous(0, 80, true);
+            const auto r2 = fs.lock_continuous(40, 80, true);
+            cfs_assert_simple(r2.data() - r1.data() == static_cast<int64_t>(40 * fs.static_info_.block_size));
+        }
     }
     catch (cfs::error::generalCFSbaseError & e) {
         elog(e.what(), "\n");
@@ -91,6 +91,59 @@ int main(int argc, char ** argv)
 
         dlog(total_positives_in_map, ", ", total_positives_in_reflection, /* ", ", total_positives_in_reflection2, */ "\n");
         cfs_assert_simple(total_positives_in_reflection == total_positives_in_map /* && total_positives_in_map == total_positives_in_reflection2 */);
+
+        // free space summary follows set_bit(), and is rebuilt the same on mount
+        cfs_assert_simple(raid1_bitmap.free_bits() == len - total_positives_in_map);
+        cfs_assert_simple(raid1_bitmap.commit() == 0); // mirrors agree, as on unmount
+        cfs::cfs_bitmap_block_mirroring_t remounted_bitmap(&fs, &journal);
+        cfs_assert_simple(remounted_bitmap.free_bits() == raid1_bitmap.free_bits());
+        for (uint64_t i = 0, expected = 0; i < len; i = expected + 1)
+        {
+            expected = i;
+            while (expected < len && raid1_bitmap.get_bit(expected)) expected++;
+            cfs_assert_simple(raid1_bitmap.find_first_zero(i, len) == expected);
+        }
+
+        // the mirror is only read back for a page whose checksum fails, and merged, so a bit set since the
+        // last commit survives while one cleared behind the bitmap's back comes back
+        cfs_assert_simple(raid1_bitmap.commit() == 0);
+        uint64_t kept = 0;
+        while (!raid1_bitmap.get_bit(kept)) kept++;
+        const uint64_t fresh = raid1_bitmap.find_first_zero(0, len);
+        cfs_assert_simple(fresh < len);
+        raid1_bitmap.set_bit(fresh, true); // set since the last commit, mirror2 doesn't know it yet
+        {
+            const auto page = fs.lock(fs.static_info_.data_bitmap_start);
+            page.data()[kept / 8] &= static_cast<char>(~(1 << (kept % 8))); // write behind the bitmap's back
+        }
+        cfs_assert_simple(!raid1_bitmap.get_bit(kept));
+        cfs_assert_simple(raid1_bitmap.commit() == 1);
+        cfs_assert_simple(raid1_bitmap.get_bit(kept) && raid1_bitmap.get_bit(fresh));
+        cfs_assert_simple(raid1_bitmap.free_bits() == len - total_positives_in_map - 1);
+
+        // mirrors that differ on mount keep every bit set in either of them
+        const auto bitmap_pages = fs.static_info_.data_bitmap_end - fs.static_info_.data_bitmap_start;
+        const uint64_t damaged = std::min(len - 1, fs.static_info_.block_size * 8 + 3); // cleared in mirror1 only
+        raid1_bitmap.set_bit(damaged, true);
+        cfs_assert_simple(raid1_bitmap.commit() == 0);
+        const uint64_t lagging = raid1_bitmap.find_first_zero(0, len); // set in mirror1 only, mirror2 lagged behind
+        cfs_assert_simple(lagging < len);
+        {
+            const auto map1 = fs.lock_continuous(fs.static_info_.data_bitmap_start, bitmap_pages);
+            map1.data()[lagging / 8] |= static_cast<char>(1 << (lagging % 8));
+            map1.data()[damaged / 8] &= static_cast<char>(~(1 << (damaged % 8)));
+        }
+        {
+            cfs::cfs_bitmap_block_mirroring_t merged_bitmap(&fs, &journal);
+            cfs_assert_simple(merged_bitmap.get_bit(lagging));
+            cfs_assert_simple(merged_bitmap.get_bit(damaged));
+            cfs_assert_simple(merged_bitmap.commit() == 0);
+        }
+        {
+            const auto map1 = fs.lock_continuous(fs.static_info_.data_bitmap_start, bitmap_pages, true);
+            const auto map2 = fs.lock_continuous(fs.static_info_.data_bitmap_backup_start, bitmap_pages, true);
+            cfs_assert_simple(std::memcmp(map1.data(), map2.data(), map1.size()) == 0);
+        }
     }
     catch (cfs::error::generalCFSbaseError & e) {
         elog(e.what(), "\n");
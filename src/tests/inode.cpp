@@ -7,6 +7,16 @@
 #include <unistd.h>
 #include "utils.h"
 #include <random>
+#include <thread>
+
+/// exposes the block resolver, so tests can tell whether a write went in place or was CoW'd
+class inode_probe_t : public cfs::cfs_inode_service_t
+{
+public:
+    using cfs_inode_service_t::cfs_inode_service_t;
+    using cfs_inode_service_t::resolve_block;
+    using cfs_inode_service_t::modifiable_in_place;
+};
 
 int main(int argc, char ** argv)
 {
@@ -34,14 +44,197 @@ int main(int argc, char ** argv)
         raid1_bitmap.set_bit(0, true); // mark 0 as allocated
         raid1_bitmap.set_bit(1, true);
         block_attribute.set<cfs::block_type>(1, cfs::INDEX_NODE_BLOCK);
-        cfs::cfs_inode_service_t inode(0, &fs, &block_manager, &journal, &block_attribute);
-        inode.resize(6);
-        inode.write("123", 3, 0);
-        inode.write("456", 3, 3);
-        std::vector<char> data (6);
-        inode.read(data.data(), data.size(), 0);
-        std::ranges::for_each(data, [](const char c){ std::cout << c; });
-        std::cout << std::endl;
+        {
+            cfs::cfs_inode_service_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+            inode.resize(6);
+            inode.write("123", 3, 0);
+            inode.write("456", 3, 3);
+            std::vector<char> data (6);
+            inode.read(data.data(), data.size(), 0);
+            std::ranges::for_each(data, [](const char c){ std::cout << c; });
+            std::cout << std::endl;
+        }
+
+        // block map is cached across inode service instances, make sure it follows the pointer tree
+        std::vector<char> reference(512 * 300);
+        std::mt19937 rng(std::random_device{}());
+        std::ranges::generate(reference, [&]{ return static_cast<char>(rng()); });
+        {
+            cfs::cfs_inode_service_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+            inode.write(reference.data(), reference.size(), 0);
+        }
+
+        std::uniform_int_distribution<uint64_t> offset_dist(0, reference.size() - 1);
+        for (int i = 0; i < 64; i++)
+        {
+            cfs::cfs_inode_service_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+            const auto offset = offset_dist(rng);
+            const auto size = std::min<uint64_t>(offset_dist(rng) % 2048 + 1, reference.size() - offset);
+            std::vector<char> patch(size);
+            std::ranges::generate(patch, [&]{ return static_cast<char>(rng()); });
+            inode.write(patch.data(), patch.size(), offset);
+            std::memcpy(reference.data() + offset, patch.data(), patch.size());
+
+            std::vector<char> data(reference.size());
+            cfs_assert_simple(inode.read(data.data(), data.size(), 0) == reference.size());
+            cfs_assert_simple(data == reference);
+        }
+
+        // every write above CoW'd pointer blocks as well, the cached map took each redirect along
+        {
+            std::vector<uint64_t> cached, on_disk;
+            {
+                inode_probe_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+                for (uint64_t i = 0; i < reference.size() / 512; i++) {
+                    cached.push_back(inode.resolve_block(i));
+                }
+            }
+
+            block_manager.block_map_cache().invalidate(0);
+            inode_probe_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+            for (uint64_t i = 0; i < reference.size() / 512; i++) {
+                on_disk.push_back(inode.resolve_block(i));
+            }
+            cfs_assert_simple(cached == on_disk);
+        }
+
+        // a map handed out is current until the pointer tree changes without it
+        {
+            cfs::cfs_block_map_cache_t cache;
+            auto map = std::make_shared<cfs::cfs_block_map_cache_t::block_map_t>();
+            map->level3_pointers = { 1, 2, 3 };
+            cache.put(5, map);
+            cfs_assert_simple(cache.current(5, *map) && cache.get(5) == map);
+            cache.changed(5);
+            cfs_assert_simple(!cache.current(5, *map) && cache.get(5) == nullptr);
+
+            const auto newer = std::make_shared<cfs::cfs_block_map_cache_t::block_map_t>(*map);
+            cache.put(5, newer);
+            cfs_assert_simple(!cache.current(5, *map) && cache.current(5, *newer));
+            cache.put(5, newer); // followed a change, still current
+            cfs_assert_simple(cache.current(5, *newer) && cache.get(5) == newer);
+        }
+
+        // inside a transaction group, a block is CoW'd once and then modified in place
+        block_manager.transaction_group().set_mode(cfs::cfs_transaction_group_t::default_timeout);
+        {
+            inode_probe_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+            inode.write("A", 1, 0);
+            const auto block = inode.resolve_block(0);
+            inode.write("B", 1, 1);
+            cfs_assert_simple(inode.resolve_block(0) == block);
+
+            block_manager.transaction_group().commit(); // sealed, CoW again
+            inode.write("C", 1, 2);
+            cfs_assert_simple(inode.resolve_block(0) != block);
+
+            std::memcpy(reference.data(), "ABC", 3);
+            std::vector<char> data(reference.size());
+            cfs_assert_simple(inode.read(data.data(), data.size(), 0) == reference.size());
+            cfs_assert_simple(data == reference);
+        }
+        block_manager.transaction_group().set_mode(0);
+
+        // the timer commits a group that nothing touches anymore
+        block_manager.transaction_group().set_mode(1);
+        {
+            inode_probe_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+            inode.write("A", 1, 0);
+            const auto sequence = journal.newest_sequence();
+            auto committed = [&]
+            {
+                const auto actions = journal.dump_actions();
+                return std::ranges::any_of(actions, [&](const cfs::cfs_action_t & action) {
+                    return action.sequence > sequence && action.action_data.action_plain.action == cfs::TransactionGroupCommit;
+                });
+            };
+
+            for (int i = 0; i < 50 && !committed(); i++) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            cfs_assert_simple(committed());
+        }
+        block_manager.transaction_group().set_mode(0);
+
+        // overwrite-if-exclusive: blocks no snapshot can see are modified in place, frozen ones are CoW'd
+        fs.global_control_flags.store({ .no_pointer_and_storage_cow = 0, .overwrite_exclusive_blocks = 1 });
+        {
+            inode_probe_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+            const auto block = inode.resolve_block(1);
+            inode.write("D", 1, 512);
+            cfs_assert_simple(inode.resolve_block(1) == block);
+
+            block_attribute.set<cfs::block_status>(block, cfs::BLOCK_FROZEN_AND_IS_SNAPSHOT_REGULAR_BLOCK_0x02);
+            inode.write("E", 1, 513);
+            cfs_assert_simple(inode.resolve_block(1) != block);
+
+            std::memcpy(reference.data() + 512, "DE", 2);
+            std::vector<char> data(reference.size());
+            cfs_assert_simple(inode.read(data.data(), data.size(), 0) == reference.size());
+            cfs_assert_simple(data == reference);
+        }
+        fs.global_control_flags.store({});
+
+        // NOCOW inode: same as overwrite-if-exclusive, but for this inode only
+        {
+            inode_probe_t inode(0, &fs, &block_manager, &journal, &block_attribute);
+            inode.chflags(cfs::inode_flag_nocow);
+            const auto block = inode.resolve_block(2);
+            inode.write("F", 1, 1024);
+            cfs_assert_simple(inode.resolve_block(2) == block);
+
+            block_attribute.set<cfs::block_status>(block, cfs::BLOCK_FROZEN_AND_IS_SNAPSHOT_REGULAR_BLOCK_0x02);
+            inode.write("G", 1, 1025);
+            cfs_assert_simple(inode.resolve_block(2) != block);
+
+            // NOCOW only covers data blocks, the same block is CoW'd as metadata. Asking journals nothing
+            const auto sequence = journal.newest_sequence();
+            cfs_assert_simple(inode.modifiable_in_place(inode.resolve_block(2), true));
+            cfs_assert_simple(!inode.modifiable_in_place(inode.resolve_block(2)));
+            cfs_assert_simple(journal.newest_sequence() == sequence);
+            inode.chflags(0);
+
+            std::memcpy(reference.data() + 1024, "FG", 2);
+            std::vector<char> data(reference.size());
+            cfs_assert_simple(inode.read(data.data(), data.size(), 0) == reference.size());
+            cfs_assert_simple(data == reference);
+        }
+
+        // two files appended in turns still get one contiguous run of storage blocks each
+        // (transaction groups on, as mounted, so freshly appended blocks are written in place)
+        block_manager.transaction_group().set_mode(cfs::cfs_transaction_group_t::default_timeout);
+        {
+            auto make_empty_inode = [&]->uint64_t
+            {
+                const auto index = block_manager.allocate(block_manager.metadata_goal(1));
+                block_attribute.set<cfs::block_type>(index, cfs::INDEX_NODE_BLOCK);
+                const auto lock = fs.lock(index + fs.static_info_.data_table_start);
+                std::memset(lock.data(), 0, lock.size());
+                return index;
+            };
+
+            const uint64_t files[] = { make_empty_inode(), make_empty_inode() };
+            const std::vector<char> chunk(512 * 4, 'L');
+            constexpr uint64_t rounds = 32;
+            for (uint64_t round = 0; round < rounds; round++)
+            {
+                for (const auto file : files)
+                {
+                    inode_probe_t inode(file, &fs, &block_manager, &journal, &block_attribute);
+                    inode.write(chunk.data(), chunk.size(), round * chunk.size());
+                }
+            }
+
+            for (const auto file : files)
+            {
+                inode_probe_t inode(file, &fs, &block_manager, &journal, &block_attribute);
+                const auto first = inode.resolve_block(0);
+                for (uint64_t i = 1; i < rounds * 4; i++) {
+                    cfs_assert_simple(inode.resolve_block(i) == first + i);
+                }
+            }
+        }
+        block_manager.transaction_group().set_mode(0);
     }
     catch (cfs::error::generalCFSbaseError & e) {
         elog(e.what(), "\n");
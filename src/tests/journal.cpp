@@ -22,10 +22,12 @@ int main(int argc, char ** argv)
             cfs::make_cfs(disk, 512, "test");
         }
         cfs::filesystem fs(disk);
-        cfs::cfs_journaling_t journaling(&fs);
+        auto journaling_ptr = std::make_unique<cfs::cfs_journaling_t>(&fs);
+        auto & journaling = *journaling_ptr;
         std::vector < cfs::cfs_action_t > action_mirror;
         const auto cell_size = (fs.static_info_.journal_end - fs.static_info_.journal_start) * fs.static_info_.block_size / sizeof(cfs::cfs_action_t);
 
+        uint64_t sequence = journaling.newest_sequence() + 1;
         auto push_action = [&](
             const uint64_t action,
             const uint64_t action_param0 = 0,
@@ -35,7 +37,10 @@ int main(int argc, char ** argv)
             const uint64_t action_param4 = 0)
         {
             cfs::cfs_action_t j_action = { };
-            j_action.cfs_magic = cfs::cfs_magick_number;
+            j_action.cfs_magic = cfs::cfs_journal_record_magic;
+            j_action.version = cfs::cfs_journal_record_version;
+            j_action.length = sizeof(cfs::cfs_action_t);
+            j_action.sequence = sequence++;
             j_action.action_data.action_plain = {
                 .action = action,
                 .action_param0 = action_param0,
@@ -44,7 +49,8 @@ int main(int argc, char ** argv)
                 .action_param3 = action_param3,
                 .action_param4 = action_param4,
             };
-            j_action.action_param_crc64 = cfs::utils::arithmetic::hash64((uint8_t*)&j_action.action_data, sizeof(j_action.action_data));
+            j_action.record_crc32 = CRC32::C::calc(reinterpret_cast<const uint8_t *>(&j_action.sequence),
+                sizeof(cfs::cfs_action_t) - offsetof(cfs::cfs_action_t, sequence));
             action_mirror.push_back(j_action);
             while (action_mirror.size() >= cell_size) action_mirror.erase(action_mirror.begin());
         };
@@ -59,6 +65,166 @@ int main(int argc, char ** argv)
         std::ranges::for_each(action_mirror, [&](const cfs::cfs_action_t & action) {
             cfs_assert_simple(std::memcmp(&ac[index++], &action, sizeof(cfs::cfs_action_t)) == 0);
         });
+
+        // concurrent pushes are grouped into commits, every action lands in the ring exactly once and in order per thread
+        {
+            constexpr uint64_t threads_count = 4;
+            const uint64_t per_thread = (cell_size - 1) / threads_count;
+            std::vector<std::thread> threads;
+            for (uint64_t t = 0; t < threads_count; t++)
+            {
+                threads.emplace_back([&, t] {
+                    for (uint64_t i = 0; i < per_thread; i++) {
+                        journaling.push_action(0xFFFF, t, i);
+                    }
+                });
+            }
+            std::ranges::for_each(threads, [](std::thread & T) { T.join(); });
+
+            std::vector<uint64_t> next(threads_count, 0);
+            uint64_t found = 0;
+            for (const auto & action : journaling.dump_actions())
+            {
+                const auto & plain = action.action_data.action_plain;
+                if (plain.action != 0xFFFF) continue;
+                cfs_assert_simple(plain.action_param1 == next[plain.action_param0]++);
+                found++;
+            }
+            cfs_assert_simple(found == per_thread * threads_count);
+        }
+
+        // nested transactions are counted in the outermost closing record. Those naming blocks, and failed ones,
+        // leave one NestedTransaction record each, tagged with the sequence of the outermost start record
+        {
+            using namespace cfs; // g_transaction() names actions unqualified
+            auto transaction = [&](const bool outer_success)
+            {
+                bool success = false;
+                g_transaction(&journaling, success, GlobalTransaction_Major_WriteInode, 7, 0, 0);
+                for (uint64_t i = 0; i < 2; i++)
+                {
+                    bool inner_success = false;
+                    g_transaction(&journaling, inner_success, FilesystemBitmapModification, 0, 1, i);
+                    {
+                        bool innermost_success = false;
+                        g_transaction(&journaling, innermost_success, GlobalTransaction_CreateRedundancy, i, i + 1);
+                        innermost_success = true;
+                    }
+                    inner_success = true;
+                }
+                {
+                    bool failed = false; // names no blocks, only its failure shows up
+                    g_transaction(&journaling, failed, GlobalTransaction_AllocateBlock);
+                }
+                success = outer_success;
+            };
+
+            transaction(true);
+            transaction(false);
+            const auto actions = journaling.dump_actions();
+            cfs_assert_simple(actions.size() >= 14);
+            for (const auto * last : { &actions.back() - 13, &actions.back() - 6 })
+            {
+                cfs_assert_simple(last[0].action_data.action_plain.action == cfs::GlobalTransaction);
+                cfs_assert_simple(last[0].action_data.action_plain.action_param0 == cfs::GlobalTransaction_Major_WriteInode);
+                for (int i = 1; i <= 5; i++)
+                {
+                    cfs_assert_simple(last[i].action_data.action_plain.action == cfs::NestedTransaction);
+                    cfs_assert_simple(last[i].action_data.action_plain.action_param4 == last[0].sequence);
+                }
+                cfs_assert_simple(last[1].action_data.action_plain.action_param0 == cfs::FilesystemBitmapModification);
+                cfs_assert_simple(last[1].action_data.action_plain.action_param3 == 0);
+                cfs_assert_simple(last[2].action_data.action_plain.action_param0 == cfs::GlobalTransaction_CreateRedundancy);
+                cfs_assert_simple(last[2].action_data.action_plain.action_param2 == 1);
+                cfs_assert_simple(last[4].action_data.action_plain.action_param2 == 2);
+                cfs_assert_simple(last[5].action_data.action_plain.action_param0 == cfs::GlobalTransaction_AllocateBlock_Failed);
+                cfs_assert_simple(last[6].action_data.action_plain.action == cfs::GlobalTransaction);
+                cfs_assert_simple(last[6].action_data.action_plain.action_param4 == 5);
+            }
+            cfs_assert_simple((&actions.back() - 7)->action_data.action_plain.action_param0
+                == cfs::GlobalTransaction_Major_WriteInode_Completed);
+            cfs_assert_simple(actions.back().action_data.action_plain.action_param0
+                == cfs::GlobalTransaction_Major_WriteInode_Failed);
+        }
+
+        // records carry consecutive sequences, streaming can start anywhere and the sequence survives a remount
+        {
+            const auto actions = journaling.dump_actions();
+            for (uint64_t i = 1; i < actions.size(); i++) {
+                cfs_assert_simple(actions[i].sequence == actions[i - 1].sequence + 1);
+            }
+
+            uint64_t newest = journaling.newest_sequence();
+            cfs_assert_simple(newest == actions.back().sequence);
+
+            const uint64_t from = actions[actions.size() / 2].sequence;
+            uint64_t expected = from;
+            journaling.for_each_action(from, [&](const cfs::cfs_action_t & action) {
+                cfs_assert_simple(action.sequence == expected++);
+            });
+            cfs_assert_simple(expected == newest + 1);
+
+            journaling_ptr.reset();
+            {
+                cfs::cfs_journaling_t reopened(&fs);
+                cfs_assert_simple(reopened.newest_sequence() == newest);
+                cfs_assert_simple(reopened.push_action(0xFFFF) == newest + 1);
+                cfs_assert_simple(reopened.dump_actions().back().sequence == ++newest);
+            }
+
+            // move the newest record past the middle slot, where the binary search over the ring looks first
+            const uint64_t slots = (cell_size * sizeof(cfs::cfs_action_t) - sizeof(cfs::journal_header_t) * 2) / sizeof(cfs::cfs_action_t);
+            {
+                uint64_t head = 0;
+                {
+                    const auto journal = fs.lock_continuous(fs.static_info_.journal_start,
+                        fs.static_info_.journal_end - fs.static_info_.journal_start);
+                    head = reinterpret_cast<cfs::journal_header_t *>(journal.data())->head / sizeof(cfs::cfs_action_t);
+                }
+
+                cfs::cfs_journaling_t reopened(&fs);
+                for (; head <= slots / 2 + 1; head++) {
+                    newest = reopened.push_action(0xFFFF);
+                }
+            }
+
+            // a journal header that lagged behind its records, and a torn record right at the first bisect midpoint
+            uint64_t torn = 0;
+            {
+                const auto journal = fs.lock_continuous(fs.static_info_.journal_start,
+                    fs.static_info_.journal_end - fs.static_info_.journal_start);
+                auto * header = reinterpret_cast<cfs::journal_header_t *>(journal.data());
+                auto * body = reinterpret_cast<cfs::cfs_action_t *>(journal.data() + sizeof(cfs::journal_header_t));
+                const uint64_t capacity = journal.size() - sizeof(cfs::journal_header_t) * 2;
+                cfs_assert_simple(capacity / sizeof(cfs::cfs_action_t) == slots);
+                cfs_assert_simple(cfs::cfs_journaling_t::valid(body[0]) && header->head / sizeof(cfs::cfs_action_t) > slots / 2 + 1);
+                auto & record = body[slots / 2];
+                torn = record.sequence;
+                record.record_crc32 ^= 1;
+                header->head = (header->head + capacity - 3 * sizeof(cfs::cfs_action_t)) % capacity;
+            }
+            {
+                cfs::cfs_journaling_t reopened(&fs);
+                cfs_assert_simple(reopened.newest_sequence() == newest);
+                reopened.push_action(0xFFFF);
+                const auto actions_after = reopened.dump_actions();
+                cfs_assert_simple(actions_after.back().sequence == newest + 1);
+                cfs_assert_simple(actions_after[actions_after.size() - 2].sequence == newest); // nothing overwritten
+
+                uint64_t expected_after = torn;
+                reopened.for_each_action(torn, [&](const cfs::cfs_action_t & action)
+                {
+                    if (expected_after == torn) {
+                        expected_after++; // torn record is skipped
+                    }
+                    cfs_assert_simple(action.sequence == expected_after++);
+                });
+                cfs_assert_simple(expected_after == newest + 2);
+                for (uint64_t i = 1; i < actions_after.size(); i++) {
+                    cfs_assert_simple(actions_after[i].sequence > actions_after[i - 1].sequence);
+                }
+            }
+        }
     }
     catch (cfs::error::generalCFSbaseError & e) {
         elog(e.what(), "\n");
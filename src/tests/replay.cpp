@@ -0,0 +1,193 @@
+#include "smart_block_t.h"
+#include "cfsBasicComponents.h"
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <new>
+#include <thread>
+#include <unistd.h>
+#include "utils.h"
+
+/// exposes the CoW steps of a write, so a test can stop between them
+class inode_probe_t : public cfs::cfs_inode_service_t
+{
+public:
+    using cfs_inode_service_t::cfs_inode_service_t;
+    using cfs_inode_service_t::resolve_block;
+    using cfs_inode_service_t::copy_on_write;
+    using cfs_inode_service_t::retire_block;
+    using cfs_inode_service_t::relink_storage_blocks;
+    using cfs_inode_service_t::cfs_level_1_indexes;
+    using cfs_inode_service_t::lock_page;
+
+    /// a crash takes the before-images the write still held along
+    void forget_before_images() { before_images_.clear(); }
+};
+
+/// run work inside an outermost transaction that never gets its closing record, as if the system crashed.
+/// the transaction is never destroyed, and the thread's transaction stack goes away with the thread
+template < typename Work >
+void crash_inside(cfs::cfs_journaling_t & journal, const uint64_t type, const uint64_t param, Work && work)
+{
+    std::thread([&]
+    {
+        bool success = false;
+        alignas(cfs::journal_auto_write_t) std::byte storage[sizeof(cfs::journal_auto_write_t)];
+        new (storage) cfs::journal_auto_write_t(&journal, success,
+            cfs::GlobalTransaction, type, param, 0, 0, 0,
+            cfs::GlobalTransaction, type + 1, param, 0, 0, 0,
+            cfs::GlobalTransaction, type + 2, param, 0, 0, 0);
+        work();
+    }).join();
+}
+
+int main(int argc, char ** argv)
+{
+    try
+    {
+        const char * disk = "bigfile.img";
+        if (argc == 1)
+        {
+            const int fd = open(disk, O_RDWR | O_CREAT, 0644);
+            assert_throw(fd > 0, "fd");
+            assert_throw(fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, cfs::cfs_minimum_size) == 0, "fallocate() failed");
+            assert_throw(fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, cfs::cfs_minimum_size) == 0, "fallocate() failed");
+            close(fd);
+            chmod(disk, 0755);
+            cfs::make_cfs(disk, 512, "test");
+        }
+
+        using namespace cfs;
+        filesystem fs(disk);
+        cfs_journaling_t journal(&fs);
+        cfs_bitmap_block_mirroring_t bitmap(&fs, &journal);
+        cfs_block_attribute_access_t attribute(&fs, &journal);
+
+        // nothing happened since format
+        cfs_journal_replay_t(&fs, &journal, &bitmap, &attribute).replay(true);
+
+        uint64_t inode_index, original0, original1, original2, original3, copy0, copy1, lone, old_level1, new_level1;
+        std::vector < char > content(512 * 4, 'A');
+        {
+            cfs_block_manager_t block_manager(&bitmap, &fs.cfs_header_block, &attribute, &journal);
+            inode_index = block_manager.allocate();
+            attribute.set<block_type>(inode_index, INDEX_NODE_BLOCK);
+            {
+                const auto lock = fs.lock(inode_index + fs.static_info_.data_table_start);
+                std::memset(lock.data(), 0, lock.size());
+                reinterpret_cast<cfs::stat *>(lock.data())->st_ino = inode_index;
+            }
+
+            inode_probe_t inode(inode_index, &fs, &block_manager, &journal, &attribute);
+            inode.write(content.data(), content.size(), 0);
+            original0 = inode.resolve_block(0);
+            original1 = inode.resolve_block(1);
+            original2 = inode.resolve_block(2);
+            original3 = inode.resolve_block(3);
+            old_level1 = inode.cfs_level_1_indexes[0];
+            const uint64_t marker = journal.newest_sequence();
+
+            // crashed between the copy and the relink: the copy is lost, the original was retired too early
+            crash_inside(journal, GlobalTransaction_Major_WriteInode, inode_index, [&]
+            {
+                copy0 = inode.copy_on_write(original0);
+                inode.retire_block(original0);
+            });
+
+            // crashed after the relink but before the original was retired and the transaction closed
+            crash_inside(journal, GlobalTransaction_Major_WriteInode, inode_index, [&]
+            {
+                copy1 = inode.copy_on_write(original1);
+                inode.relink_storage_blocks({ { 1, copy1 } });
+            });
+            new_level1 = inode.cfs_level_1_indexes[0];
+
+            // crashed in the middle of an overwrite in place
+            fs.global_control_flags.store({ .no_pointer_and_storage_cow = 0, .overwrite_exclusive_blocks = 1 });
+            crash_inside(journal, GlobalTransaction_Major_WriteInode, inode_index, [&]
+            {
+                cfs_assert_simple(inode.copy_on_write(original2) == original2);
+                const auto lock = inode.lock_page(original2);
+                std::memset(lock->data(), 'B', 256);
+            });
+            inode.forget_before_images();
+            fs.global_control_flags.store({});
+
+            // crashed in the middle of an overwrite that took no before-image, as blocks of the transaction group
+            // don't. nothing tells how far it got
+            crash_inside(journal, GlobalTransaction_Major_WriteInode, inode_index, [&]
+            {
+                const auto lock = inode.lock_page(original3);
+                std::memset(lock->data(), 'C', 256);
+            });
+            std::memset(content.data() + 512 * 3, 'C', 256);
+
+            // crashed right after the owner typed the block
+            crash_inside(journal, GlobalTransaction_AllocateBlock, 0, [&]
+            {
+                lone = block_manager.allocate();
+                attribute.set<block_type>(lone, STORAGE_BLOCK);
+            });
+
+            cfs_assert_simple(inode.resolve_block(0) == original0 && inode.resolve_block(1) == copy1);
+            cfs_assert_simple(new_level1 != old_level1); // the pointer tree was CoW'd up to the inode
+            cfs_assert_simple(journal.newest_sequence() > marker);
+        }
+
+        cfs_assert_simple(attribute.get<block_type>(copy0) == STORAGE_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(original0) == COW_REDUNDANCY_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(original1) == STORAGE_BLOCK);
+
+        // dry run changes nothing
+        const auto dry = cfs_journal_replay_t(&fs, &journal, &bitmap, &attribute).replay(false);
+        cfs_assert_simple(dry.interrupted == 5 && dry.rolled_back == 3 && dry.rolled_forward == 1);
+        cfs_assert_simple(dry.unresolved.size() == 1 && dry.unresolved.front().action_data.action_plain.action_param0
+            == GlobalTransaction_Major_WriteInode);
+        cfs_assert_simple(attribute.get<block_type>(copy0) == STORAGE_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(original0) == COW_REDUNDANCY_BLOCK);
+
+        // unlinked blocks become redundancies, linked ones are kept, and the replaced original is retired
+        const auto report = cfs_journal_replay_t(&fs, &journal, &bitmap, &attribute).replay(true);
+        cfs_assert_simple(report.interrupted == 5 && report.rolled_back == 3 && report.rolled_forward == 1 && report.unresolved.size() == 1);
+        cfs_assert_simple(attribute.get<block_type>(original0) == STORAGE_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(copy0) == COW_REDUNDANCY_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(original1) == COW_REDUNDANCY_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(copy1) == STORAGE_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(lone) == COW_REDUNDANCY_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(inode_index) == INDEX_NODE_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(new_level1) == POINTER_BLOCK);
+        cfs_assert_simple(attribute.get<block_type>(old_level1) == COW_REDUNDANCY_BLOCK);
+
+        // the file reads back as before the crashes, the overwrite with a before-image included and the
+        // one without left as it is,
+        // and the reclaimer gives every redundancy back to the bitmap
+        {
+            cfs_block_manager_t block_manager(&bitmap, &fs.cfs_header_block, &attribute, &journal);
+            inode_probe_t inode(inode_index, &fs, &block_manager, &journal, &attribute);
+            std::vector < char > data(content.size());
+            cfs_assert_simple(inode.read(data.data(), data.size(), 0) == content.size() && data == content);
+
+            while (block_manager.reclaimer().reclaim(cfs_redundancy_reclaimer_t::batch) != 0) { }
+            for (const auto index : { copy0, original1, lone, old_level1 }) {
+                cfs_assert_simple(!bitmap.get_bit(index));
+            }
+            for (const auto index : { original0, copy1, new_level1, inode_index }) {
+                cfs_assert_simple(bitmap.get_bit(index));
+            }
+        }
+
+        // next replay starts after the marker
+        const auto again = cfs_journal_replay_t(&fs, &journal, &bitmap, &attribute).replay(true);
+        cfs_assert_simple(again.interrupted == 0);
+        cfs_assert_simple(journal.dump_actions().back().action_data.action_plain.action == JournalReplayed);
+    }
+    catch (cfs::error::generalCFSbaseError & e) {
+        elog(e.what(), "\n");
+        return EXIT_FAILURE;
+    }
+    catch (std::exception& e) {
+        elog(e.what(), "\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
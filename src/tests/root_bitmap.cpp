@@ -0,0 +1,113 @@
+#include "inode.h"
+#include "smart_block_t.h"
+#include "cfsBasicComponents.h"
+#include <fcntl.h>
+#include <filesystem>
+#include <linux/falloc.h>
+#include <unistd.h>
+#include "utils.h"
+
+/// the bitmap in root metadata matches the live bitmap as of the root CoW: every page not changed since
+/// is the same as the live one, and the root block itself is allocated in it
+void check_root_bitmap(cfs::filesystem & fs, cfs::cfs_block_manager_t & block_manager, cfs::dentry_t & root)
+{
+    const auto kept = root.read_root_bitmap();
+    const auto changed_since = block_manager.dump_dirty_bitmap_pages();
+    const auto live = block_manager.dump_bitmap_data();
+    cfs_assert_simple(kept.size() >= live.size());
+
+    const auto page_size = fs.static_info_.block_size;
+    auto changed = changed_since.begin();
+    for (uint64_t page = 0; page * page_size < live.size(); page++)
+    {
+        if (changed != changed_since.end() && changed->first == page) {
+            ++changed;
+            continue;
+        }
+
+        const auto size = std::min<uint64_t>(page_size, live.size() - page * page_size);
+        cfs_assert_simple(std::memcmp(kept.data() + page * page_size, live.data() + page * page_size, size) == 0);
+    }
+
+    const uint64_t root_index = fs.cfs_header_block.get_info<cfs::root_inode_pointer>();
+    cfs_assert_simple(kept[root_index / 8] & (1 << (root_index % 8)));
+}
+
+int main()
+{
+    try
+    {
+        const char * disk = "bigfile.img";
+        {
+            if (std::filesystem::exists(disk)) {
+                std::filesystem::remove(disk);
+            }
+            const int fd = open(disk, O_RDWR | O_CREAT, 0644);
+            assert_throw(fd > 0, "fd");
+            assert_throw(fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, 1024 * 1024 * 64) == 0, "fallocate() failed");
+            assert_throw(fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, 1024 * 1024 * 64) == 0, "fallocate() failed");
+            close(fd);
+            chmod(disk, 0755);
+            cfs::make_cfs(disk, 512, "test");
+        }
+
+        using namespace cfs;
+        std::vector < char > content(512 * 20, 'A');
+        for (int mount = 0; mount < 2; mount++)
+        {
+            filesystem fs(disk);
+            cfs_journaling_t journal(&fs);
+            cfs_bitmap_block_mirroring_t bitmap(&fs, &journal);
+            cfs_block_attribute_access_t attribute(&fs, &journal);
+            cfs_block_manager_t block_manager(&bitmap, &fs.cfs_header_block, &attribute, &journal);
+            dentry_t root(fs.cfs_header_block.get_info<root_inode_pointer>(), &fs, &block_manager, &journal, &attribute, nullptr);
+
+            // a root the current transaction group doesn't own is CoW'd on the next change.
+            // first one after mount takes the whole bitmap, later ones only the changed pages
+            for (int round = 0; round < 3; round++)
+            {
+                block_manager.transaction_group().commit();
+                const auto name = std::to_string(mount) + "." + std::to_string(round);
+                auto file = root.make_inode<file_t>(name);
+                check_root_bitmap(fs, block_manager, root);
+
+                file.write(content.data(), content.size(), 0);
+                while (block_manager.reclaimer().reclaim(cfs_redundancy_reclaimer_t::batch) != 0) { }
+            }
+
+            // blocks at the far end of the bitmap, in a page nothing else touches
+            const uint64_t last_block = fs.static_info_.data_table_end - fs.static_info_.data_table_start - 1;
+            if (mount == 0)
+            {
+                // changed after the last root of this mount, the first root of the next one has to pick it up
+                bitmap.set_bit(last_block, true);
+                attribute.set<block_type>(last_block, STORAGE_BLOCK);
+            }
+            else
+            {
+                // a reverted root carries the bitmap of the snapshot. the block is in the snapshot but
+                // gone from the live bitmap, in a page no later change marks, the next root replaces it anyway
+                cfs_assert_simple(!bitmap.get_bit(last_block - 1));
+                bitmap.set_bit(last_block - 1, true);
+                attribute.set<block_type>(last_block - 1, STORAGE_BLOCK);
+                root.snapshot("snapshot");
+                bitmap.set_bit(last_block - 1, false);
+                block_manager.transaction_group().commit();
+                root.make_inode<file_t>("after snapshot").write(content.data(), content.size(), 0);
+                root.revert("snapshot");
+                check_root_bitmap(fs, block_manager, root);
+                cfs_assert_simple(root.ls().count("after snapshot") == 0);
+            }
+        }
+    }
+    catch (cfs::error::generalCFSbaseError & e) {
+        elog(e.what(), "\n");
+        return EXIT_FAILURE;
+    }
+    catch (std::exception& e) {
+        elog(e.what(), "\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}